@@ -0,0 +1,128 @@
+// bench_CacheLayout.cc
+//
+// One producer and one consumer hand elements through a CircularQueue, first
+// with the blocking push/pop and then with tryPush/tryPop in a yield loop.
+// Built as bench_CacheLayout it measures the queue as shipped, producer and
+// consumer state on separate cache lines with cached copies of the other
+// side's cursor. Built as bench_CacheLayoutPacked (this file compiled with
+// CIRCULAR_QUEUE_PACKED_LAYOUT defined) it measures the packed layout from
+// before the split. Run both with the threads on different cores, e.g.
+//
+//   taskset -c 0,2 ./bench/bench_CacheLayout
+//   taskset -c 0,2 ./bench/bench_CacheLayoutPacked
+//
+// and run them under perf to see the cache line transfers directly, e.g.
+//
+//   perf stat -e cache-misses,LLC-load-misses ./bench/bench_CacheLayout
+
+#include "CircularQueue.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+const std::size_t   Capacity   = 1024;
+const std::uint64_t Iterations = 2000000;
+
+#ifdef CIRCULAR_QUEUE_PACKED_LAYOUT
+const char* const Layout = "packed";
+#else
+const char* const Layout = "separated";
+#endif
+
+typedef cdn::container::CircularQueue<std::uint64_t, Capacity> Queue;
+
+void
+report (const std::string& name, const Queue& cq, double seconds, std::uint64_t sum)
+{
+  if (sum != Iterations * (Iterations - 1) / 2)
+  {
+    std::cerr << name << ": checksum mismatch" << std::endl;
+    std::exit (EXIT_FAILURE);
+  }
+
+  auto stats = cq.stats ();
+  std::cout << std::left << std::setw (12) << Layout << std::setw (12) << name
+            << std::right << std::setw (14) << std::fixed << std::setprecision (0)
+            << Iterations / seconds << " ops/sec"
+            << std::setw (10) << std::setprecision (3)
+            << static_cast<double> (stats.lockContended) / (2 * Iterations)
+            << " contended/op" << std::endl;
+}
+
+void
+runBlocking ()
+{
+  Queue cq (cdn::container::CircularQueueMode::BlockOnWrite);
+  std::uint64_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now ();
+
+  std::thread consumer ([&]
+                        {
+                          for (std::uint64_t i=0; i < Iterations; ++i)
+                          {
+                            sum += cq.pop ();
+                          }
+                        });
+
+  for (std::uint64_t i=0; i < Iterations; ++i)
+  {
+    cq.push (i);
+  }
+  consumer.join ();
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  report ("push/pop", cq, elapsed.count (), sum);
+}
+
+void
+runTry ()
+{
+  Queue cq (cdn::container::CircularQueueMode::FailOnWrite);
+  std::uint64_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now ();
+
+  std::thread consumer ([&]
+                        {
+                          std::uint64_t val = 0;
+                          for (std::uint64_t i=0; i < Iterations; ++i)
+                          {
+                            while (cq.tryPop (val) != cdn::container::CircularQueueStatus::Ok)
+                            {
+                              std::this_thread::yield ();
+                            }
+                            sum += val;
+                          }
+                        });
+
+  for (std::uint64_t i=0; i < Iterations; ++i)
+  {
+    while (cq.tryPush (i) != cdn::container::CircularQueueStatus::Ok)
+    {
+      std::this_thread::yield ();
+    }
+  }
+  consumer.join ();
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+  report ("try", cq, elapsed.count (), sum);
+}
+
+} // namespace
+
+int
+main ()
+{
+  runBlocking ();
+  runTry ();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+// bench_CacheLayoutPacked.cc
+//
+// bench_CacheLayout against the CircularQueue layout from before the 
+// producer and consumer state were split by cache line, compare its output
+// with bench_CacheLayout.
+
+#define CIRCULAR_QUEUE_PACKED_LAYOUT
+#include "bench_CacheLayout.cc"
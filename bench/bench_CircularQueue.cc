@@ -0,0 +1,363 @@
+// bench_CircularQueue.cc
+//
+// Throughput and enqueue-to-dequeue latency of CircularQueue for each
+// CircularQueueMode across producer/consumer thread counts, element sizes and
+// capacities. One line is written per configuration, as CSV (the default) or
+// JSON, so runs from different builds can be diffed or loaded side by side.
+//
+//   ./bench/bench_CircularQueue [--format csv|json] [--ops N]
+//
+// --ops is the number of elements each producer pushes (default 200000).
+//
+// Every element carries the steady_clock time it was pushed, the consumer
+// takes the difference once it is popped. In NonBlockingWrite mode the
+// overwritten elements are never popped, so "popped" can be less than
+// "pushed" and only the popped elements count toward ops/sec and latency.
+// FailOnWrite producers retry a full queue, each retry is a "failed_push".
+
+#include "CircularQueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+//! An element of Bytes bytes, the first of which are the push time
+template <std::size_t Bytes>
+struct Payload
+{
+  static_assert (Bytes >= sizeof (std::int64_t), "Payload too small for the timestamp");
+
+  std::int64_t pushedNs;
+  char         pad[Bytes - sizeof (std::int64_t)];
+};
+
+struct Config
+{
+  cdn::container::CircularQueueMode mode;
+  std::size_t                       producers;
+  std::size_t                       consumers;
+  std::size_t                       elementBytes;
+  std::size_t                       capacity;
+};
+
+struct Result
+{
+  std::uint64_t pushed;
+  std::uint64_t popped;
+  std::uint64_t failedPushes;
+  double        opsPerSec;
+  std::int64_t  p50Ns;
+  std::int64_t  p99Ns;
+  std::int64_t  p999Ns;
+};
+
+enum class Format
+{
+  Csv,
+  Json
+};
+
+std::int64_t
+nowNs ()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds> (Clock::now ().time_since_epoch ()).count ();
+}
+
+const char*
+modeName (cdn::container::CircularQueueMode mode)
+{
+  switch (mode)
+  {
+  case cdn::container::CircularQueueMode::FailOnWrite:      return "FailOnWrite";
+  case cdn::container::CircularQueueMode::BlockOnWrite:     return "BlockOnWrite";
+  case cdn::container::CircularQueueMode::NonBlockingWrite: return "NonBlockingWrite";
+  }
+  return "Unknown";
+}
+
+// latencies is sorted in place
+std::int64_t
+percentile (std::vector<std::int64_t>& latencies, double pct)
+{
+  if (latencies.empty ())
+  {
+    return 0;
+  }
+  auto idx = static_cast<std::size_t> (pct / 100.0 * (latencies.size () - 1));
+  return latencies[idx];
+}
+
+template <std::size_t Bytes>
+Result
+run (const Config& config, std::uint64_t opsPerProducer)
+{
+  typedef Payload<Bytes> Element;
+
+  cdn::container::CircularQueue<Element> cq (config.mode,
+                                             cdn::container::CircularQueueCapacity (config.capacity));
+
+  std::atomic<std::uint64_t> failedPushes (0);
+  // each consumer fills its own vector, reserved up front so recording a
+  // latency never allocates while the clock is running
+  std::vector<std::vector<std::int64_t>> latencies (config.consumers);
+  for (auto& l : latencies)
+  {
+    l.reserve (opsPerProducer * config.producers);
+  }
+
+  std::vector<std::thread> threads;
+  auto start = Clock::now ();
+
+  for (std::size_t c=0; c < config.consumers; ++c)
+  {
+    threads.emplace_back ([&cq, &latencies, c]
+                          {
+                            auto& mine = latencies[c];
+                            try
+                            {
+                              for (;;)
+                              {
+                                auto e = cq.pop ();
+                                mine.push_back (nowNs () - e.pushedNs);
+                              }
+                            }
+                            catch (const cdn::container::CircularQueueShutdown&)
+                            {
+                              // drained
+                            }
+                          });
+  }
+
+  std::vector<std::thread> producers;
+  for (std::size_t p=0; p < config.producers; ++p)
+  {
+    producers.emplace_back ([&cq, &failedPushes, opsPerProducer]
+                            {
+                              Element e;
+                              std::memset (&e, 0, sizeof (e));
+                              std::uint64_t failed = 0;
+                              for (std::uint64_t i=0; i < opsPerProducer; ++i)
+                              {
+                                for (;;)
+                                {
+                                  e.pushedNs = nowNs ();
+                                  try
+                                  {
+                                    cq.push (e);
+                                    break;
+                                  }
+                                  catch (const cdn::container::CircularQueueError&)
+                                  {
+                                    // FailOnWrite and the queue is full
+                                    ++failed;
+                                    std::this_thread::yield ();
+                                  }
+                                }
+                              }
+                              failedPushes += failed;
+                            });
+  }
+
+  for (auto& t : producers)
+  {
+    t.join ();
+  }
+
+  // a consumer that was parked when shutdown is called throws rather than
+  // popping, so let the consumers drain the queue first
+  while (! cq.isEmpty ())
+  {
+    std::this_thread::yield ();
+  }
+  cq.shutdown ();
+  for (auto& t : threads)
+  {
+    t.join ();
+  }
+
+  std::chrono::duration<double> elapsed = Clock::now () - start;
+
+  std::vector<std::int64_t> all;
+  for (auto& l : latencies)
+  {
+    all.insert (all.end (), l.begin (), l.end ());
+  }
+  std::sort (all.begin (), all.end ());
+
+  Result result;
+  result.pushed       = opsPerProducer * config.producers;
+  result.popped       = all.size ();
+  result.failedPushes = failedPushes;
+  result.opsPerSec    = all.size () / elapsed.count ();
+  result.p50Ns        = percentile (all, 50.0);
+  result.p99Ns        = percentile (all, 99.0);
+  result.p999Ns       = percentile (all, 99.9);
+  return result;
+}
+
+Result
+runSized (const Config& config, std::uint64_t opsPerProducer)
+{
+  switch (config.elementBytes)
+  {
+  case 16:   return run<16> (config, opsPerProducer);
+  case 256:  return run<256> (config, opsPerProducer);
+  case 1024: return run<1024> (config, opsPerProducer);
+  }
+  std::cerr << "Unsupported element size " << config.elementBytes << std::endl;
+  std::exit (EXIT_FAILURE);
+}
+
+void
+writeHeader (Format format)
+{
+  if (format == Format::Csv)
+  {
+    std::cout << "mode,producers,consumers,element_bytes,capacity,"
+              << "pushed,popped,failed_pushes,ops_per_sec,p50_ns,p99_ns,p999_ns"
+              << std::endl;
+  }
+  else
+  {
+    std::cout << "[" << std::endl;
+  }
+}
+
+void
+writeResult (Format format, const Config& config, const Result& result, bool first)
+{
+  if (format == Format::Csv)
+  {
+    std::cout << modeName (config.mode) << ','
+              << config.producers << ','
+              << config.consumers << ','
+              << config.elementBytes << ','
+              << config.capacity << ','
+              << result.pushed << ','
+              << result.popped << ','
+              << result.failedPushes << ','
+              << static_cast<std::uint64_t> (result.opsPerSec) << ','
+              << result.p50Ns << ','
+              << result.p99Ns << ','
+              << result.p999Ns
+              << std::endl;
+  }
+  else
+  {
+    std::cout << (first ? "  " : ", ")
+              << "{\"mode\": \"" << modeName (config.mode) << "\""
+              << ", \"producers\": " << config.producers
+              << ", \"consumers\": " << config.consumers
+              << ", \"element_bytes\": " << config.elementBytes
+              << ", \"capacity\": " << config.capacity
+              << ", \"pushed\": " << result.pushed
+              << ", \"popped\": " << result.popped
+              << ", \"failed_pushes\": " << result.failedPushes
+              << ", \"ops_per_sec\": " << static_cast<std::uint64_t> (result.opsPerSec)
+              << ", \"p50_ns\": " << result.p50Ns
+              << ", \"p99_ns\": " << result.p99Ns
+              << ", \"p999_ns\": " << result.p999Ns
+              << "}" << std::endl;
+  }
+}
+
+void
+writeFooter (Format format)
+{
+  if (format == Format::Json)
+  {
+    std::cout << "]" << std::endl;
+  }
+}
+
+void
+usage (const char* prog)
+{
+  std::cerr << "usage: " << prog << " [--format csv|json] [--ops N]" << std::endl;
+  std::exit (EXIT_FAILURE);
+}
+
+} // namespace
+
+int
+main (int argc, char* argv[])
+{
+  Format format = Format::Csv;
+  std::uint64_t opsPerProducer = 200000;
+
+  for (int i=1; i < argc; ++i)
+  {
+    std::string arg (argv[i]);
+    if (arg == "--format" && i + 1 < argc)
+    {
+      std::string value (argv[++i]);
+      if (value == "csv")
+      {
+        format = Format::Csv;
+      }
+      else if (value == "json")
+      {
+        format = Format::Json;
+      }
+      else
+      {
+        usage (argv[0]);
+      }
+    }
+    else if (arg == "--ops" && i + 1 < argc)
+    {
+      opsPerProducer = std::strtoull (argv[++i], nullptr, 10);
+      if (opsPerProducer == 0)
+      {
+        usage (argv[0]);
+      }
+    }
+    else
+    {
+      usage (argv[0]);
+    }
+  }
+
+  const cdn::container::CircularQueueMode modes[] =
+    {
+      cdn::container::CircularQueueMode::FailOnWrite,
+      cdn::container::CircularQueueMode::BlockOnWrite,
+      cdn::container::CircularQueueMode::NonBlockingWrite
+    };
+  const std::size_t threads[][2] = { { 1, 1 }, { 1, 4 }, { 4, 1 }, { 4, 4 } };
+  const std::size_t sizes[]      = { 16, 256, 1024 };
+  const std::size_t capacities[] = { 64, 4096 };
+
+  writeHeader (format);
+  bool first = true;
+  for (auto mode : modes)
+  {
+    for (auto& pc : threads)
+    {
+      for (auto bytes : sizes)
+      {
+        for (auto capacity : capacities)
+        {
+          Config config = { mode, pc[0], pc[1], bytes, capacity };
+          writeResult (format, config, runSized (config, opsPerProducer), first);
+          first = false;
+        }
+      }
+    }
+  }
+  writeFooter (format);
+
+  return EXIT_SUCCESS;
+}
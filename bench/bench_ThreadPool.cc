@@ -0,0 +1,186 @@
+// bench_ThreadPool.cc
+//
+// Tasks per second of ThreadPool against the pool every team used to build,
+// worker threads popping std::function tasks off one shared CircularQueue,
+// for 1 up to hardware_concurrency workers. The work is a binary tree of
+// small tasks, every inner task submits its two halves from inside the pool,
+// so the shared queue is hit by every worker for every task while ThreadPool
+// workers mostly stay on their own deque.
+//
+//   ./bench/bench_ThreadPool [--leaves N]
+//
+// --leaves is the number of leaf tasks in the tree (default 1048576), each
+// spins for a few hundred nanoseconds.
+
+#include "CircularQueue.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+typedef std::function<void ()> Task;
+
+std::atomic<std::uint64_t> g_sink (0);
+
+void
+leaf (std::uint64_t seed)
+{
+  std::uint64_t x = seed;
+  for (int i=0; i < 256; ++i)
+  {
+    x = x * 6364136223846793005ull + 1442695040888963407ull;
+  }
+  g_sink.fetch_add (x & 1, std::memory_order_relaxed);
+}
+
+// Split [first, first + count) until single leaves, submit hands a task to
+// the pool under test
+template <typename Submit>
+void
+split (Submit& submit, std::atomic<std::uint64_t>& done, std::uint64_t first, std::uint64_t count)
+{
+  if (count == 1)
+  {
+    leaf (first);
+    done.fetch_add (1, std::memory_order_relaxed);
+    return;
+  }
+  auto half = count / 2;
+  submit ([&submit, &done, first, half] { split (submit, done, first, half); });
+  submit ([&submit, &done, first, half, count] { split (submit, done, first + half, count - half); });
+}
+
+void
+waitFor (const std::atomic<std::uint64_t>& done, std::uint64_t leaves)
+{
+  while (done.load (std::memory_order_relaxed) < leaves)
+  {
+    std::this_thread::sleep_for (std::chrono::microseconds (100));
+  }
+}
+
+double
+runThreadPool (std::size_t workers, std::uint64_t leaves)
+{
+  cdn::thread::ThreadPool pool (workers);
+  std::atomic<std::uint64_t> done (0);
+  std::function<void (Task&&)> submit = [&pool] (Task&& task) { pool.submit (std::move (task)); };
+
+  auto start = std::chrono::steady_clock::now ();
+  pool.submit ([&] { split (submit, done, 0, leaves); });
+  waitFor (done, leaves);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  return (2 * leaves - 1) / elapsed.count ();
+}
+
+double
+runSharedQueue (std::size_t workers, std::uint64_t leaves)
+{
+  // Room for every task of the tree so a worker never blocks on its own push
+  cdn::container::CircularQueue<Task> queue (cdn::container::CircularQueueMode::FailOnWrite,
+                                             cdn::container::CircularQueueCapacity (2 * leaves));
+  std::atomic<std::uint64_t> done (0);
+  std::function<void (Task&&)> submit = [&queue] (Task&& task) { queue.push (std::move (task)); };
+
+  std::vector<std::thread> threads;
+  for (std::size_t w=0; w < workers; ++w)
+  {
+    threads.emplace_back ([&]
+                          {
+                            try
+                            {
+                              for (;;)
+                              {
+                                queue.pop () ();
+                              }
+                            }
+                            catch (const cdn::container::CircularQueueShutdown&)
+                            {
+                            }
+                          });
+  }
+
+  auto start = std::chrono::steady_clock::now ();
+  queue.push ([&] { split (submit, done, 0, leaves); });
+  waitFor (done, leaves);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now () - start;
+
+  queue.shutdown ();
+  for (auto& t : threads)
+  {
+    t.join ();
+  }
+
+  return (2 * leaves - 1) / elapsed.count ();
+}
+
+void
+usage (const char* argv0)
+{
+  std::cerr << "usage: " << argv0 << " [--leaves N]" << std::endl;
+  std::exit (EXIT_FAILURE);
+}
+
+} // namespace
+
+int
+main (int argc, char* argv[])
+{
+  std::uint64_t leaves = 1 << 20;
+
+  for (int i=1; i < argc; ++i)
+  {
+    std::string arg (argv[i]);
+    if (arg == "--leaves" && i + 1 < argc)
+    {
+      leaves = std::strtoull (argv[++i], nullptr, 10);
+      if (leaves == 0)
+      {
+        usage (argv[0]);
+      }
+    }
+    else
+    {
+      usage (argv[0]);
+    }
+  }
+
+  std::size_t cores = std::thread::hardware_concurrency ();
+  if (cores == 0)
+  {
+    cores = 1;
+  }
+
+  std::cout << std::left << std::setw (10) << "workers"
+            << std::right << std::setw (16) << "ThreadPool"
+            << std::setw (16) << "shared queue" << "   tasks/sec" << std::endl;
+
+  for (std::size_t workers=1; workers <= cores; workers *= 2)
+  {
+    auto pool = runThreadPool (workers, leaves);
+    auto shared = runSharedQueue (workers, leaves);
+
+    std::cout << std::left << std::setw (10) << workers
+              << std::right << std::fixed << std::setprecision (0)
+              << std::setw (16) << pool
+              << std::setw (16) << shared << std::endl;
+
+    if (workers < cores && workers * 2 > cores)
+    {
+      workers = cores / 2;
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+// BroadcastQueue.h
+//
+#ifndef CDN_BROADCAST_QUEUE_INCLUDED
+#define CDN_BROADCAST_QUEUE_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on EventCount
+#include "EventCount.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief The BroadcastQueue class is a bounded lock-free ring where every
+//! subscriber sees every element
+//!
+//! Where a CircularQueue hands each element to one consumer, a BroadcastQueue
+//! hands it to all of its subscribers. An element is constructed once, in
+//! its slot, and every subscriber reads it there through a handler taking a
+//! const T&, so fanning out to many consumers costs neither copies nor
+//! locks. Any number of threads may push, each subscriber is read by one
+//! thread.
+//!
+//! Every subscriber has its own read sequence, on its own cache line, and
+//! consume hands it everything published since its last call in one batch.
+//! A subscriber can be placed after others, it then only sees an element
+//! once all of those have consumed it, which arranges the consumers in
+//! stages (for example journal and replicate, then apply).
+//!
+//! The CircularQueueMode semantics:
+//!  - FailOnWrite raises CircularQueueError when the slowest subscriber is N
+//!    elements behind
+//!  - BlockOnWrite makes the producer wait for the slowest subscriber
+//!  - NonBlockingWrite never waits for the subscribers, a subscriber that
+//!    falls N elements behind skips ahead to the oldest element still on the
+//!    ring and missed counts what it lost. Slots can then be rewritten while
+//!    they are read, so the handler gets a copy that was checked against the
+//!    slot sequence after it was taken, and T must be
+//!    <a href="http://en.cppreference.com/w/cpp/types/is_trivially_copyable">TriviallyCopyable</a>.
+//!
+//! An element is only seen by the subscribers that were there when it was
+//! pushed. subscribe and unsubscribe must not run concurrently with push or
+//! consume.
+//!
+//! At a minimum T must meet the requirements of
+//! <a href="http://en.cppreference.com/w/cpp/concept/Destructible">Destructible</a>.
+//! An element stays in its slot, constructed, until the slot is reused.
+//!
+//! The cursors and cells are cache line aligned, BroadcastQueue derives from
+//! CacheAligned so a queue created with new is aligned as well.
+//!
+template <typename T, std::size_t N>
+class BroadcastQueue
+  : public CacheAligned<BroadcastQueue<T, N>>
+{
+  static_assert (N > 0, "BroadcastQueue requires a capacity of at least one element");
+
+public:
+  //! The maximum number of subscribers
+  static constexpr std::size_t MaxSubscribers = 64;
+
+  //! No elements are constructed until they are pushed
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if mode is
+  //! NonBlockingWrite and T is not trivially copyable
+  explicit
+  BroadcastQueue (const CircularQueueMode&)
+    throw (CircularQueueError);
+
+  //! Destroy the elements still in their slots
+  ~BroadcastQueue ();
+
+  //! = delete
+  BroadcastQueue (const BroadcastQueue&) = delete;
+  //! = delete
+  BroadcastQueue& operator= (const BroadcastQueue&) = delete;
+
+  //! = delete
+  BroadcastQueue (BroadcastQueue&&) = delete;
+  //! = delete
+  BroadcastQueue& operator= (BroadcastQueue&&) = delete;
+
+  //! Add a subscriber that sees every element pushed from now on
+  //!
+  //! \return The number consume takes for the subscriber, the lowest free one
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there are already
+  //! MaxSubscribers subscribers
+  std::size_t
+  subscribe ()
+    throw (CircularQueueError);
+
+  //! Add a subscriber that sees an element only after every subscriber in
+  //! after has consumed it, starting where the furthest behind of them is
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there are already
+  //! MaxSubscribers subscribers or a subscriber in after does not exist
+  std::size_t
+  subscribe (std::initializer_list<std::size_t> after)
+    throw (CircularQueueError);
+
+  //! Remove a subscriber, producers no longer wait for it and its number is
+  //! free for reuse
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! subscriber or another subscriber is placed after it
+  void
+  unsubscribe (std::size_t subscriber)
+    throw (CircularQueueError);
+
+  //! Number of subscribers
+  std::size_t
+  subscribers ()
+    const
+    noexcept;
+
+  //! Number of elements pushed that subscriber has not consumed yet,
+  //! including elements being pushed
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! subscriber
+  std::size_t
+  size (std::size_t subscriber)
+    const
+    throw (CircularQueueError);
+
+  //! The maximum number of elements a subscriber can fall behind
+  std::size_t
+  max ()
+    const
+    noexcept;
+
+  //! Number of elements subscriber lost by falling N elements behind in
+  //! NonBlockingWrite mode
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! subscriber
+  std::uint64_t
+  missed (std::size_t subscriber)
+    const
+    throw (CircularQueueError);
+
+  //! Tell the queue to shutdown, this will force any blocking push or
+  //! consume to return
+  void
+  shutdown ()
+    noexcept;
+
+  //! Return true if the queue has been shutdown
+  bool
+  isShutdown ()
+    const
+    noexcept;
+
+  //! Construct the element in place in the next slot, potentially waiting
+  //! for the slowest subscriber based upon the mode
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full
+  //! in FailOnWrite mode, on mutex error or if the T constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  template <typename... Args>
+  void
+  emplace (Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element into the next slot, see emplace
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the element into the next slot, see emplace
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (T&&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Call handler (const T&) for every element available to subscriber, in
+  //! order, waiting forever if there are none. The read sequence is advanced
+  //! once for the whole batch.
+  //!
+  //! \return The number of elements handed to handler
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! subscriber, on mutex error or if handler throws, the elements before
+  //! the one handler threw on are consumed and so is that one
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if nothing is
+  //! available and the queue has been shutdown
+  template <typename Handler>
+  std::size_t
+  consume (std::size_t subscriber, Handler handler)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Call handler (const T&) for every element available to subscriber, if
+  //! there are none before the timeout expires zero is returned
+  //!
+  //! \throw CircularQueueError See consume
+  //! \throw CircularQueueShutdown See consume
+  template <typename Handler, typename Rep, typename Period>
+  std::size_t
+  consume (std::size_t subscriber,
+           Handler handler,
+           const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Call handler (const T&) for every element available to subscriber
+  //! without waiting
+  //!
+  //! \throw CircularQueueError See consume
+  //! \throw CircularQueueShutdown See consume
+  template <typename Handler>
+  std::size_t
+  tryConsume (std::size_t subscriber, Handler handler)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+private:
+
+  static constexpr std::size_t CacheLine = CacheLineSize;
+
+  typedef typename std::aligned_storage<sizeof (T), alignof (T)>::type Slot;
+
+  //! \brief Internal type for a slot and its sequence number
+  //!
+  //! sequence == pos + 1      the slot holds the element pushed at pos
+  //! sequence == 0            the slot was never written, or in
+  //!                          NonBlockingWrite mode is being rewritten
+  struct Cell
+  {
+    std::atomic<std::uint64_t> sequence;
+    // false when the T constructor threw after the slot was claimed, the
+    // subscribers skip the slot instead of stalling on it
+    bool                       isConstructed;
+    Slot                       storage;
+  };
+
+  //! \brief Internal type for a subscriber, on its own cache line
+  struct alignas (CacheLine) Cursor
+  {
+    // The next element the subscriber reads, written by its thread only
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint64_t> missed;
+    // Mask of the subscribers it is placed after
+    std::uint64_t              after;
+  };
+
+  Cell&
+  cell (std::uint64_t)
+    noexcept;
+
+  void
+  checkSubscriber (std::size_t)
+    const
+    throw (CircularQueueError);
+
+  // The sequence of the slowest subscriber, the claim cursor if there are
+  // none
+  std::uint64_t
+  slowest ()
+    const
+    noexcept;
+
+  bool
+  hasRoom ()
+    const
+    noexcept;
+
+  bool
+  claim (std::uint64_t&)
+    noexcept;
+
+  void
+  makeRoom ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // How far subscriber may read, as far as the subscribers it is placed
+  // after have got
+  std::uint64_t
+  limit (const Cursor&)
+    const
+    noexcept;
+
+  bool
+  isAvailable (std::size_t subscriber)
+    const
+    noexcept;
+
+  // Hand everything available to handler and advance the read sequence
+  template <typename Handler>
+  std::size_t
+  drain (std::size_t subscriber, Handler&)
+    throw (CircularQueueError);
+
+  const CircularQueueMode   m_mode;
+  std::atomic<bool>         m_isShutdown;
+  // Only changed by subscribe and unsubscribe
+  std::uint64_t             m_used;
+  std::uint64_t             m_hasDependents;
+  thread::EventCount        m_published;
+  thread::EventCount        m_consumed;
+
+  alignas (CacheLine) std::atomic<std::uint64_t> m_claim;
+  // Last known sequence of the slowest subscriber, producers only look at
+  // the subscribers again once they catch up with it
+  alignas (CacheLine) std::atomic<std::uint64_t> m_gate;
+  std::array<Cursor, MaxSubscribers>             m_cursors;
+  alignas (CacheLine) Cell                       m_cells[N];
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "BroadcastQueue.icc"
+
+#endif // #ifndef CDN_BROADCAST_QUEUE_INCLUDED
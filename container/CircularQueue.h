@@ -3,11 +3,16 @@
 #ifndef CDN_CIRCULAR_QUEUE_INCLUDED
 #define CDN_CIRCULAR_QUEUE_INCLUDED
 
-#include <array>
-#include <condition_variable>
-#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
 
 // TODO: dependency on boost
 #include "boost/optional.hpp"
@@ -15,6 +20,17 @@
 // TODO: dependency on DataGuard
 #include "DataGuard.h"
 
+// TODO: dependency on FutexCondition
+#include "FutexCondition.h"
+
+// TODO: dependency on EventFd
+#include "EventFd.h"
+
+#include "LatencyHistogram.h"
+#include "QueueSet.h"
+#include "RingStorage.h"
+#include "WaitStrategy.h"
+
 
 //! The main namespace for the codin-lib
 namespace cdn
@@ -23,44 +39,14 @@ namespace cdn
 namespace container
 {
 
-//! CircularQueue encounterd a fatal error, likely caused by a mutex error
-class CircularQueueError
-  : public std::runtime_error 
-{ 
-public:
-  CircularQueueError (const std::string&);
-};
-
-//! CircularQueue has been shutdown
-class CircularQueueShutdown
-  : public std::runtime_error
-{
-public:
-  CircularQueueShutdown ();
-};
-
-//! The CircularQueueMode enum controls the behavior of the CircularQueue when
-//! it reaches a queue full state.
-enum class CircularQueueMode 
-{
-  FailOnWrite,     /*!< Writer will not overwrite an element that has not been
-                        read yet. If the queue is full and in this mode, the 
-                        exception CircularQueueError will be raised
-                   */
- 
-  BlockOnWrite,    /*!< Writer will not overwrite an element that has not been
-                        read yet. If the queue is full and in this mode the 
-                        push or emplace call will block and wait until there
-                        is room for the element
-                   */ 
-
-  NonBlockingWrite /*!< Writer will overwrite an element that has not been read
-                        yet
-                   */
-};
-
 //! \brief The CircularQueue class provides a thread-safe queue based upon std::array<>
 //!
+//! With N set to DynamicCapacity (the default) the capacity is instead given
+//! to the constructor as a CircularQueueCapacity, and the buffer is allocated
+//! once, optionally on huge pages, when the queue is constructed. Queue depth
+//! can then come from configuration and very large queues do not have to 
+//! live inside the CircularQueue object.
+//!
 //! This queue orders elements FIFO (first-in-first-out). The front/head of the
 //! queue is that element that has been on the queue the longest time. The 
 //! back/tail of the queue is that element that has been on the queue the 
@@ -68,29 +54,95 @@ enum class CircularQueueMode
 //! queue, and the queue retrieval operations via pop obtain elements from the 
 //! head of the queue. 
 //!
+//! The head and tail of the queue are free running 64 bit counts of pops and
+//! pushes, so full, empty and size are plain subtraction. A power of two 
+//! capacity maps the counts onto slots with a mask rather than a modulo.
+//!
+//! The slots are uninitialized storage, an element is constructed in place
+//! when it is pushed and destroyed as soon as it is popped, so constructing 
+//! even a very large queue is O(1) and only the slots that are used are ever
+//! touched.
+//!
+//! Every queue keeps operational counters (pushes, pops, overwritten 
+//! elements, full/empty waits and wait time, high-water mark and lock 
+//! contention), see stats and writeStats.
+//!
+//! With Latency set to TrackLatency every element is stamped with the time 
+//! it was pushed and, when it is popped, the time it sat on the queue is 
+//! added to a LatencyHistogram, see latencySnapshot. Elements dropped by 
+//! NonBlockingWrite are not counted. The default NoLatencyTracking adds no
+//! state and no code.
+//!
+//! Wait picks how a consumer waits for an element and a BlockOnWrite 
+//! producer waits for room. BlockingWait (the default) parks on a condition
+//! variable straight away, BusySpinWait spins and never sleeps, 
+//! SpinYieldWait spins and then yields between checks, and SpinParkWait 
+//! spins for an adaptive while before parking. The spinning policies release
+//! the queue lock while they spin and never cost the other side a notify.
+//!
+//! A queue can also be watched from a poll/epoll event loop instead of 
+//! blocking in pop, see readinessFd, or together with other queues by one
+//! consumer, see QueueSet.
+//!
 //! At a minimum T must meet the requirements of 
-//! <a href="http://en.cppreference.com/w/cpp/concept/DefaultConstructible">DefaultConstructible</a>, 
-//! <a href="http://en.cppreference.com/w/cpp/concept/CopyConstructible">CopyConstructible</a> and 
-//! <a href="http://en.cppreference.com/w/cpp/concept/CopyAssignable">CopyAssignable</a>.
+//! <a href="http://en.cppreference.com/w/cpp/concept/Destructible">Destructible</a> and 
+//! <a href="http://en.cppreference.com/w/cpp/concept/MoveConstructible">MoveConstructible</a>,
+//! so move-only types such as std::unique_ptr<> and types without a default
+//! constructor can be queued. Elements are moved out of the queue when 
+//! popped, unless T can only be copied or its move constructor may throw, in
+//! which case they are copied.
 //! The individual methods that require additional concepts are documented on those methods.
+//!
+//! The producer and consumer state sit on their own cache lines, which makes
+//! the queue over-aligned. It derives from CacheAligned so a queue created 
+//! with new is still aligned to the cache line.
 //!              
-template <typename T, std::size_t N>
+template <typename T, 
+          std::size_t N = DynamicCapacity,
+          typename Latency = NoLatencyTracking,
+          typename Wait = BlockingWait>
 class CircularQueue
+  : public CacheAligned<CircularQueue<T, N, Latency, Wait>>
 {
+  struct Bookkeeping;
+  typedef thread::RecursiveDataGuard<Bookkeeping> Guard;
+
 public:
 
-  //! Default initialize all the elements in the array
+  //! The type returned by pop. This is T so the popped element can be moved
+  //! to the caller. Types that can be copied but have a deleted move 
+  //! constructor can not be returned as a T prvalue in C++11, for those it 
+  //! is const T.
+  typedef typename std::conditional<std::is_move_constructible<T>::value,
+                                    T,
+                                    const T>::type pop_type;
+
+  //! Create an empty queue, no elements are constructed
   CircularQueue (const CircularQueueMode&)
     throw (CircularQueueError);
 
-  //! Initialize all the elements in the array with a copy of initialValue
+  //! Create an empty queue, no elements are constructed
+  //!
+  //! \deprecated The slots are no longer pre-filled, so initialValue is 
+  //! ignored. Kept for source compatibility, use 
+  //! CircularQueue(const CircularQueueMode&) instead.
   explicit 
   CircularQueue (const CircularQueueMode&,
                  const T& initialValue)
     throw (CircularQueueError);
 
-  //! = default
-  ~CircularQueue () = default;
+  //! Allocate an uninitialized buffer of capacity.slots elements, only
+  //! available when N is DynamicCapacity
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if capacity.slots is
+  //! zero or the buffer can not be allocated
+  CircularQueue (const CircularQueueMode&,
+                 const CircularQueueCapacity& capacity)
+    throw (CircularQueueError);
+
+  //! Destroy the elements still on the queue, and remove the queue from the
+  //! QueueSet it still belongs to
+  ~CircularQueue ();
 
   //! = delete
   CircularQueue (const CircularQueue&) = delete;
@@ -119,7 +171,8 @@ public:
     throw (CircularQueueError);
 
   //! The std::size_t that the Queue was allocated with, which is the 
-  //! maximum number of element the Queue can hold
+  //! maximum number of element the Queue can hold. This is N, or the 
+  //! CircularQueueCapacity slots for a DynamicCapacity queue.
   //!
   //! noexcept
   std::size_t
@@ -142,18 +195,25 @@ public:
     const
     throw (CircularQueueError);
 
+  //! Copy of the histogram of how long popped elements sat on the queue, in
+  //! nanoseconds, optionally resetting it so the next snapshot only covers
+  //! the elements popped after this one. Only available with the 
+  //! TrackLatency policy.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  LatencyHistogram
+  latencySnapshot (bool reset = false)
+    throw (CircularQueueError);
+
   // TODO: clear method
 	
   // TODO: test class that supports move assign but not move const
 
-  //! Move the element onto the queue, potentially waiting for space based upon
-  //! the mode
-  //!
-  //! T must support
-  //! <a href="http://en.cppreference.com/w/cpp/concept/MoveAssignable">MoveAssignable</a> 
+  //! Construct the element in place on the queue from args, potentially 
+  //! waiting for space based upon the mode
   //!
   //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
-  //! the T move assignment operator throws
+  //! the T constructor throws, the queue is left unchanged
   //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
   //! been shutdown
   template <typename... Args>
@@ -164,38 +224,466 @@ public:
   //! Copy the element onto the queue, potentially waiting for space based upon
   //! the mode.
   //!
+  //! T must support
+  //! <a href="http://en.cppreference.com/w/cpp/concept/CopyConstructible">CopyConstructible</a> 
+  //!
   //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
-  //! the T copy assignment operator throws
+  //! the T copy constructor throws, the queue is left unchanged
   //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
   //! been shutdown
   void
   push (const T&)
     throw (CircularQueueError, CircularQueueShutdown);
 
-  //! Attempt to pop the front of the queue and return a copy of it, waiting
-  //! forever if the queue contains no elements
+  //! Move the element onto the queue, potentially waiting for space based upon
+  //! the mode.
   //!
   //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
-  //! the T copy constructor throws
+  //! the T move constructor throws, the queue is left unchanged
   //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
   //! been shutdown
-  const T
+  void
+  push (T&&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Construct the element in place on the queue from args without waiting.
+  //! A full queue is reported rather than raised, in NonBlockingWrite mode 
+  //! the oldest element is dropped as with emplace.
+  //!
+  //! \return Ok if the element was pushed, Full if there was no room or 
+  //! Shutdown if there was no room and the queue has been shutdown
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T constructor throws, the queue is left unchanged
+  template <typename... Args>
+  CircularQueueStatus
+  tryEmplace (Args&&... args)
+    throw (CircularQueueError);
+
+  //! Copy the element onto the queue without waiting, see tryEmplace
+  //!
+  //! \throw CircularQueueError See tryEmplace
+  CircularQueueStatus
+  tryPush (const T&)
+    throw (CircularQueueError);
+
+  //! Move the element onto the queue without waiting, see tryEmplace. The 
+  //! element is only moved from when Ok is returned.
+  //!
+  //! \throw CircularQueueError See tryEmplace
+  CircularQueueStatus
+  tryPush (T&&)
+    throw (CircularQueueError);
+
+  //! Copy the element onto the queue, waiting up to rel_time for room. A 
+  //! FailOnWrite queue waits here too, a NonBlockingWrite queue never waits 
+  //! and drops its oldest element as push does.
+  //!
+  //! \return Ok if the element was pushed, Timeout if there was still no 
+  //! room when the timeout expired or Shutdown if the queue was shutdown 
+  //! while full
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T copy constructor throws, the queue is left unchanged
+  template <typename Rep, typename Period>
+  CircularQueueStatus
+  tryPush (const T&, const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError);
+
+  //! Move the element onto the queue, waiting up to rel_time for room, see 
+  //! tryPush (const T&, rel_time). The element is only moved from when Ok is
+  //! returned.
+  //!
+  //! \throw CircularQueueError See tryPush (const T&, rel_time)
+  template <typename Rep, typename Period>
+  CircularQueueStatus
+  tryPush (T&&, const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError);
+
+  //! Attempt to pop the front of the queue and move it out to the caller, 
+  //! waiting forever if the queue contains no elements
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T move/copy constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  pop_type
   pop ()
     throw (CircularQueueError, CircularQueueShutdown);
 
-  //! Attempt to pop the front of the queue and return a copy of it, if there
-  //! are no available elements before the timeout expires an 'empty' 
+  //! Attempt to pop the front of the queue and move it out to the caller, if
+  //! there are no available elements before the timeout expires an 'empty' 
   //! optional<T> will be returned.
   //!
   //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
-  //! the T copy constructor throws
+  //! the T move/copy constructor throws
   //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
   //! been shutdown
   template <typename Rep, typename Period>
-  boost::optional<const T>
+  boost::optional<pop_type>
   pop (const std::chrono::duration<Rep, Period>& rel_time)
     throw (CircularQueueError, CircularQueueShutdown);
 
+  //! Attempt to pop the front of the queue without waiting, the element is
+  //! move assigned into out so the caller can reuse its storage.
+  //!
+  //! T must support
+  //! <a href="http://en.cppreference.com/w/cpp/concept/MoveAssignable">MoveAssignable</a> 
+  //! (copy assignment is used for types that can only be copied)
+  //!
+  //! \return Ok if an element was popped, Empty if the queue was empty or
+  //! Shutdown if it was empty and has been shutdown
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T move/copy assignment operator throws, the element stays on the 
+  //! queue
+  CircularQueueStatus
+  tryPop (T& out)
+    throw (CircularQueueError);
+
+  //! Copy the elements [first, last) onto the queue, as many as fit are 
+  //! inserted under a single lock acquisition and waiting consumers are
+  //! notified once per batch instead of once per element. Wrap the range in 
+  //! std::move_iterator to move the elements instead.
+  //!
+  //! When the queue fills up the mode decides what happens to the rest of the
+  //! range:
+  //!  - FailOnWrite stops inserting and returns the iterator to the first
+  //!    element that was not inserted, no exception is raised
+  //!  - BlockOnWrite waits for room and keeps going until the range is done
+  //!  - NonBlockingWrite overwrites the oldest elements
+  //!
+  //! \return last, or in FailOnWrite mode the first element not inserted
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T copy constructor throws, the elements before the failing one 
+  //! remain on the queue
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue 
+  //! was shutdown while waiting for room
+  template <typename InputIt>
+  InputIt
+  pushRange (InputIt first, InputIt last)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop up to maxCount elements into out under a single lock acquisition, 
+  //! waiting forever if the queue contains no elements. Waiting producers are
+  //! notified once for the whole batch.
+  //!
+  //! \return The number of elements written to out
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T move/copy assignment throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  template <typename OutputIt>
+  std::size_t
+  popBulk (OutputIt out, std::size_t maxCount)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop up to maxCount elements into out under a single lock acquisition, 
+  //! if there are no available elements before the timeout expires zero is
+  //! returned.
+  //!
+  //! \return The number of elements written to out
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T move/copy assignment throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  template <typename OutputIt, typename Rep, typename Period>
+  std::size_t
+  popBulk (OutputIt out, 
+           std::size_t maxCount,
+           const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop every element currently on the queue into out under a single lock
+  //! acquisition, never waits.
+  //!
+  //! \return The number of elements written to out, zero if the queue was 
+  //! empty
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if 
+  //! the T move/copy assignment throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  template <typename OutputIt>
+  std::size_t
+  popAll (OutputIt out)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! A file descriptor that becomes readable when the queue goes from empty 
+  //! to not empty, from full to not full or is shutdown, so the queue can 
+  //! sit in the same poll/epoll set as sockets. The descriptor is created on
+  //! the first call and owned by the queue, a queue that never calls 
+  //! readinessFd makes no system calls for it.
+  //!
+  //! Only those transitions raise the signal, so an event loop should call
+  //! clearReadiness first and then drain the queue with popAll or tryPop 
+  //! (and retry the pushes that failed on a full queue). Elements left on 
+  //! the queue do not make the descriptor readable again.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the descriptor can not be created
+  int
+  readinessFd ()
+    throw (CircularQueueError);
+
+  //! Make readinessFd () unreadable again. Does nothing if readinessFd has
+  //! not been called yet.
+  //!
+  //! \return true if the descriptor was readable
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  bool
+  clearReadiness ()
+    throw (CircularQueueError);
+
+  class Reservation;
+  class ReadView;
+
+  //! Look at the elements at the head of the queue in place, waiting forever
+  //! if the queue contains no elements. Nothing is removed until 
+  //! ReadView::consume.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  ReadView
+  peek ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Look at the elements at the head of the queue in place, if there are no
+  //! available elements before the timeout expires an empty ReadView is 
+  //! returned.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  template <typename Rep, typename Period>
+  ReadView
+  peek (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Reserve the next slot so the producer can write the element in place,
+  //! potentially waiting for space based upon the mode. The element is not
+  //! visible to consumers until Reservation::commit.
+  //!
+  //! T must support
+  //! <a href="http://en.cppreference.com/w/cpp/concept/DefaultConstructible">DefaultConstructible</a>,
+  //! the slot is default initialized before it is handed out
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full
+  //! in FailOnWrite mode, on mutex error or if the T default constructor 
+  //! throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  Reservation
+  reserve ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Reserve up to count contiguous slots, at least one. Fewer are returned
+  //! when there is less room or the buffer wraps before count slots, in
+  //! NonBlockingWrite mode the oldest elements are dropped to make room.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if count is zero, the
+  //! queue is full in FailOnWrite mode, on mutex error or if the T default
+  //! constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  Reservation
+  reserve (std::size_t count)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! \brief Contiguous slots reserved by CircularQueue::reserve
+  //!
+  //! The Reservation holds the queue lock until it is committed or 
+  //! destroyed, so fill it in and commit promptly. The lock is recursive, 
+  //! but the reserved slots are the ones the next push would use, so a push,
+  //! pushRange or reserve from the same thread in the meantime raises 
+  //! CircularQueueError. Destroying a Reservation that was not committed 
+  //! destroys the reserved elements and leaves the queue unchanged.
+  class Reservation
+  {
+  public:
+    //! Take over the reservation of rhs
+    Reservation (Reservation&& rhs)
+      noexcept;
+
+    //! Roll the reservation back if it was not committed
+    ~Reservation ();
+
+    //! = delete
+    Reservation (const Reservation&) = delete;
+    //! = delete
+    Reservation& operator= (const Reservation&) = delete;
+    //! = delete
+    Reservation& operator= (Reservation&&) = delete;
+
+    //! Number of reserved slots, zero once committed
+    std::size_t
+    size ()
+      const
+      noexcept;
+
+    //! The first reserved element
+    T*
+    begin ()
+      noexcept;
+
+    //! One past the last reserved element
+    T*
+    end ()
+      noexcept;
+
+    //! The reserved element idx
+    T&
+    operator[] (std::size_t idx)
+      noexcept;
+
+    //! The first reserved element
+    T&
+    operator* ()
+      noexcept;
+
+    //! The first reserved element
+    T*
+    operator-> ()
+      noexcept;
+
+    //! Publish every reserved element to the consumers and release the lock
+    //!
+    //! \throw CircularQueueError Raise CircularQueueError on mutex error
+    void
+    commit ()
+      throw (CircularQueueError);
+
+    //! Publish the first count reserved elements, the rest are destroyed, 
+    //! and release the lock
+    //!
+    //! \throw CircularQueueError Raise CircularQueueError on mutex error
+    void
+    commit (std::size_t count)
+      throw (CircularQueueError);
+
+  private:
+    friend class CircularQueue;
+
+    Reservation (CircularQueue&, 
+                 std::unique_lock<Guard>&&,
+                 T*,
+                 std::size_t)
+      noexcept;
+
+    void
+    destroy (std::size_t first)
+      noexcept;
+
+    CircularQueue*          m_queue;
+    std::unique_lock<Guard> m_lock;
+    T*                      m_slots;
+    std::size_t             m_count;
+  };
+
+  //! \brief The elements at the head of the queue, seen in place by 
+  //! CircularQueue::peek
+  //!
+  //! The elements are oldest first in first() and then, when they wrap 
+  //! around the end of the buffer, in second(). Like a Reservation the 
+  //! ReadView holds the queue lock until it is consumed or destroyed, and the
+  //! spans are only valid until then. Destroying a ReadView without consuming
+  //! leaves every element on the queue.
+  class ReadView
+  {
+  public:
+    //! Take over the view of rhs
+    ReadView (ReadView&& rhs)
+      noexcept;
+
+    //! Release the lock, the elements stay on the queue
+    ~ReadView () = default;
+
+    //! = delete
+    ReadView (const ReadView&) = delete;
+    //! = delete
+    ReadView& operator= (const ReadView&) = delete;
+    //! = delete
+    ReadView& operator= (ReadView&&) = delete;
+
+    //! Number of elements in view, zero on timeout or once consumed
+    std::size_t
+    size ()
+      const
+      noexcept;
+
+    //! True if there are no elements in view
+    bool
+    empty ()
+      const
+      noexcept;
+
+    //! The oldest elements, up to the end of the buffer
+    CircularQueueSpan<const T>
+    first ()
+      const
+      noexcept;
+
+    //! The elements that wrapped around to the start of the buffer, empty if
+    //! none did
+    CircularQueueSpan<const T>
+    second ()
+      const
+      noexcept;
+
+    //! The element idx, counting from the oldest across both spans
+    const T&
+    operator[] (std::size_t idx)
+      const
+      noexcept;
+
+    //! Remove the oldest count elements (all of them if count is larger) 
+    //! from the queue and release the lock
+    //!
+    //! \throw CircularQueueError Raise CircularQueueError on mutex error
+    void
+    consume (std::size_t count)
+      throw (CircularQueueError);
+
+  private:
+    friend class CircularQueue;
+
+    ReadView ()
+      noexcept;
+
+    ReadView (CircularQueue&,
+              std::unique_lock<Guard>&&,
+              CircularQueueSpan<const T>,
+              CircularQueueSpan<const T>)
+      noexcept;
+
+    CircularQueue*             m_queue;
+    std::unique_lock<Guard>    m_lock;
+    CircularQueueSpan<const T> m_first;
+    CircularQueueSpan<const T> m_second;
+  };
+
+
+  //! Snapshot of the operational counters, read without taking the queue
+  //! lock so it can be polled as often as needed
+  //!
+  //! noexcept
+  CircularQueueStats
+  stats ()
+    const
+    noexcept;
+
+  //! Write stats () in the Prometheus text exposition format labelled with 
+  //! queue="name", see writePrometheus
+  void
+  writeStats (std::ostream&, 
+              const std::string& name,
+              bool withHelp = true)
+    const;
 
   //! For debug purposes only
   //! The container T type must have a stream insertion operator defined in the
@@ -203,55 +691,294 @@ public:
   void dump (std::ostream&);
 
 private:
+  friend class QueueSet;
 
-  struct Bookkeeping;
-  typedef thread::RecursiveDataGuard<Bookkeeping> Guard;
+  // Lock the bookkeeping, counting the acquisitions that find it held
+  std::unique_lock<Guard>
+  acquire ()
+    const;
+
+
+  // The functors are template parameters rather than std::function so the
+  // capturing lambdas passed by push/emplace/pop are never copied to the heap.
+  // The element is only constructed when the room functor returns Ok.
+  template <typename InsertFunctor, typename RoomFunctor>
+  CircularQueueStatus
+  insert (InsertFunctor, RoomFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Make room for one element according to the mode, waiting or dropping 
+  // the oldest element as needed
+  void
+  makeRoom (std::unique_lock<Guard>&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Make room for one element without waiting, only NonBlockingWrite drops
+  // the oldest element
+  CircularQueueStatus
+  tryMakeRoom (std::unique_lock<Guard>&)
+    noexcept;
+
+  // Make room for one element, waiting up to rel_time unless the mode is
+  // NonBlockingWrite, which drops the oldest element instead
+  template <typename Rep, typename Period>
+  CircularQueueStatus
+  tryMakeRoom (std::unique_lock<Guard>&,
+               const std::chrono::duration<Rep, Period>&);
+
+  template <typename WaitFunctor>
+  boost::optional<pop_type>
+  popImpl (WaitFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
 
-  void 
-  insert (std::function<void(std::unique_lock<Guard>&, std::size_t)>)
+  template <typename OutputIt, typename WaitFunctor>
+  std::size_t
+  popBulkImpl (OutputIt, std::size_t, WaitFunctor)
     throw (CircularQueueError, CircularQueueShutdown);
 
-  boost::optional<const T>
-  popImpl (std::function<bool(std::unique_lock<Guard>&)>)
+  template <typename WaitFunctor>
+  ReadView
+  peekImpl (WaitFunctor)
     throw (CircularQueueError, CircularQueueShutdown);
 
-  std::size_t 
-  nextIndex (std::size_t)
+  // The park functions wait on the matching condition variable while 
+  // counting the thread in the waiters bookkeeping, the wake functions skip
+  // the notify entirely when nobody is parked
+  template <typename Predicate>
+  void
+  parkConsumer (std::unique_lock<Guard>&, Predicate);
+
+  template <typename Rep, typename Period, typename Predicate>
+  bool
+  parkConsumer (std::unique_lock<Guard>&,
+                const std::chrono::duration<Rep, Period>&,
+                Predicate);
+
+  template <typename Predicate>
+  void
+  parkProducer (std::unique_lock<Guard>&, Predicate);
+
+  template <typename Rep, typename Period, typename Predicate>
+  bool
+  parkProducer (std::unique_lock<Guard>&,
+                const std::chrono::duration<Rep, Period>&,
+                Predicate);
+
+  // Spin according to the Wait policy until pred holds, with the lock 
+  // released between rounds. Returns true when pred holds or the deadline
+  // passed, false when the thread should park instead.
+  template <typename Predicate>
+  bool
+  spinFor (std::unique_lock<Guard>&, 
+           const std::atomic<std::uint64_t>& signal,
+           Spinner<Wait>&,
+           Predicate,
+           std::chrono::steady_clock::time_point deadline);
+
+  void
+  wakeConsumers (const Bookkeeping&, std::size_t)
+    noexcept;
+
+  void
+  wakeProducers (const Bookkeeping&, std::size_t)
+    noexcept;
+
+  // The producer side checks for room against its cached copy of the head
+  // and the consumer side checks for elements against its cached copy of the
+  // tail, the other side's cache line is only read when the cached copy says
+  // the queue may be full/empty
+  bool
+  hasRoom (Bookkeeping&)
+    noexcept;
+
+  bool
+  hasElement (Bookkeeping&)
     noexcept;
 
+  void
+  dropOldest (Bookkeeping&)
+    noexcept;
+
+  // Count count elements made visible to consumers (tail already advanced)
+  // or removed by consumers (head already advanced), and raise the 
+  // readiness signal when that took the queue off empty or full
+  void
+  published (Bookkeeping&, std::size_t count)
+    noexcept;
+
+  void
+  consumed (const Bookkeeping&, std::size_t count)
+    noexcept;
+
+  // QueueSet membership. joinSet reports the queue to the set straight away
+  // if it already holds elements or is shutdown. hasElementHint reads the
+  // counters without the lock, it may be stale but never misses an element
+  // whose push it can see.
+  void
+  joinSet (QueueSet&, std::size_t idx)
+    throw (CircularQueueError);
+
+  void
+  leaveSet ()
+    throw (CircularQueueError);
+
+  bool
+  hasElementHint ()
+    const
+    noexcept;
+
+  // Alignment of the producer, consumer and shared groups of Counters and
+  // Bookkeeping. Defining CIRCULAR_QUEUE_PACKED_LAYOUT packs the groups 
+  // together and turns off the cached cursors, the layout from before they
+  // were split, so bench_CacheLayout can measure what the split is worth.
+#ifdef CIRCULAR_QUEUE_PACKED_LAYOUT
+  static constexpr std::size_t SideAlign = alignof (std::max_align_t);
+#else
+  static constexpr std::size_t SideAlign = CacheLineSize;
+#endif
+
+  //! \brief Internal type for the operational counters
+  //!
+  //! Every counter except lockContended is only written with the queue lock
+  //! held, so they are bumped with a relaxed load and store rather than a
+  //! locked read-modify-write, and stats () can read them without the lock.
+  //! Producer and consumer counters are on separate lines like the 
+  //! bookkeeping.
+  struct Counters
+  {
+    Counters ()
+      : pushes (0),
+        overwritten (0),
+        fullWaits (0),
+        producerWaitNs (0),
+        highWaterMark (0),
+        pops (0),
+        emptyWaits (0),
+        consumerWaitNs (0),
+        lockContended (0)
+    { }
+
+    static void
+    bump (std::atomic<std::uint64_t>& counter, std::uint64_t count)
+      noexcept
+    {
+      counter.store (counter.load (std::memory_order_relaxed) + count, 
+                     std::memory_order_relaxed);
+    }
+
+    alignas (SideAlign) std::atomic<std::uint64_t> pushes;
+    std::atomic<std::uint64_t> overwritten;
+    std::atomic<std::uint64_t> fullWaits;
+    std::atomic<std::uint64_t> producerWaitNs;
+    std::atomic<std::uint64_t> highWaterMark;
+
+    alignas (SideAlign) std::atomic<std::uint64_t> pops;
+    std::atomic<std::uint64_t> emptyWaits;
+    std::atomic<std::uint64_t> consumerWaitNs;
+
+    // Incremented before the lock is held, so a real fetch_add, but only on
+    // the contended path
+    alignas (SideAlign) std::atomic<std::uint64_t> lockContended;
+  };
+
   //! \brief Internal type for the state data
+  //!
+  //! The fields are grouped by the side that writes them, each group on its
+  //! own cache line, so a producer and a consumer running on different cores
+  //! only hand the mutex back and forth and not the bookkeeping lines. The 
+  //! waiter counts live with the side that reads them on every operation,
+  //! they are only written by threads about to park. The latency recorder
+  //! is the base class so NoLatencyTracking takes no space.
   struct Bookkeeping
+    : LatencyRecorder<Latency>
   {
     Bookkeeping (const CircularQueueMode& mode_)
-      noexcept
-      : mode (mode_),
+      : LatencyRecorder<Latency> (N),
+        mode (mode_),
+        isShutdown (false), 
+        tail (0),
+        cachedHead (0),
+        isReserved (false),
+        notEmptyWaiters (0),
+        head (0),
+        cachedTail (0),
+        notFullWaiters (0),
+        m_buffer ()
+    { }
+
+    Bookkeeping (const CircularQueueMode& mode_,
+                 const CircularQueueCapacity& capacity_)
+      : LatencyRecorder<Latency> (capacity_.slots),
+        mode (mode_),
         isShutdown (false), 
-        nextReadIndex (0),
-        nextWriteIndex (0),
-        isEmpty (true)
+        tail (0),
+        cachedHead (0),
+        isReserved (false),
+        notEmptyWaiters (0),
+        head (0),
+        cachedTail (0),
+        notFullWaiters (0),
+        m_buffer (capacity_)
     { }
 
-    ~Bookkeeping () = default;
+    // Only the slots from head up to tail hold elements, RingStorage leaves
+    // destroying them to us
+    ~Bookkeeping ()
+    {
+      for (auto pos = head; pos != tail; ++pos)
+      {
+        m_buffer.destroy (m_buffer.index (pos));
+      }
+    }
 
-    Bookkeeping (const Bookkeeping&) = default;
-    Bookkeeping& operator= (const Bookkeeping&) = default;
+    Bookkeeping (const Bookkeeping&) = delete;
+    Bookkeeping& operator= (const Bookkeeping&) = delete;
 
-    Bookkeeping (Bookkeeping&&) = default;
-    Bookkeeping& operator= (Bookkeeping&&) = default;
+    Bookkeeping (Bookkeeping&&) = delete;
+    Bookkeeping& operator= (Bookkeeping&&) = delete;
 
 
-    CircularQueueMode mode;
+    // Shared, read on every operation but rarely written
+    alignas (SideAlign) CircularQueueMode mode;
     bool              isShutdown;
-    std::size_t       nextReadIndex;
-    std::size_t       nextWriteIndex;
-    // The isEmpty flag is required in addition to the read/write indicies due to 
-    // the fact they could be euqal but the queue could be either empty or full
-    bool              isEmpty;
-    std::array<T,N>   m_buffer;
+
+    // Producer side. tail is the free running count of pushes, the next 
+    // element goes into slot m_buffer.index (tail). 64 bits never wrap.
+    alignas (SideAlign) std::uint64_t tail;
+    std::uint64_t     cachedHead;
+    // A Reservation holds the slots from tail on, nothing else may insert
+    bool              isReserved;
+    // Number of consumers parked on m_notEmpty
+    std::size_t       notEmptyWaiters;
+
+    // Consumer side. head is the free running count of pops, tail - head is
+    // the number of elements.
+    alignas (SideAlign) std::uint64_t head;
+    std::uint64_t     cachedTail;
+    // Number of producers parked on m_notFull
+    std::size_t       notFullWaiters;
+
+    // Keep the first slots off the consumer line
+    alignas (SideAlign) RingStorage<T,N> m_buffer;
   };
 
+  // Immutable after construction so max() can read it without the lock
+  const std::size_t           m_capacity;
   mutable Guard               m_bookkeeping;
-  std::condition_variable_any m_cond;
+  // Consumers wait for an element on m_notEmpty, BlockOnWrite producers 
+  // wait for room on m_notFull. On Linux these park on a futex word instead
+  // of going through condition_variable_any's internal mutex.
+  thread::FutexCondition      m_notEmpty;
+  thread::FutexCondition      m_notFull;
+  mutable Counters            m_counters;
+  // Per side spin state of the Wait policy
+  Spinner<Wait>               m_consumerSpinner;
+  Spinner<Wait>               m_producerSpinner;
+  // Created by the first readinessFd, only set and tested with the lock held
+  std::unique_ptr<thread::EventFd> m_readiness;
+  // The QueueSet the queue belongs to, only set and tested with the lock held
+  QueueSet*                   m_set;
+  std::size_t                 m_setIndex;
 };
 
 } // namespace container
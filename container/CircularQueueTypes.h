@@ -0,0 +1,271 @@
+// CircularQueueTypes.h
+//
+#ifndef CDN_CIRCULAR_QUEUE_TYPES_INCLUDED
+#define CDN_CIRCULAR_QUEUE_TYPES_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! CircularQueue encounterd a fatal error, likely caused by a mutex error
+class CircularQueueError
+  : public std::runtime_error 
+{ 
+public:
+  CircularQueueError (const std::string&);
+};
+
+//! CircularQueue has been shutdown
+class CircularQueueShutdown
+  : public std::runtime_error
+{
+public:
+  CircularQueueShutdown ();
+};
+
+//! The CircularQueueMode enum controls the behavior of the CircularQueue when
+//! it reaches a queue full state.
+enum class CircularQueueMode 
+{
+  FailOnWrite,     /*!< Writer will not overwrite an element that has not been
+                        read yet. If the queue is full and in this mode, the 
+                        exception CircularQueueError will be raised
+                   */
+ 
+  BlockOnWrite,    /*!< Writer will not overwrite an element that has not been
+                        read yet. If the queue is full and in this mode the 
+                        push or emplace call will block and wait until there
+                        is room for the element
+                   */ 
+
+  NonBlockingWrite /*!< Writer will overwrite an element that has not been read
+                        yet
+                   */
+};
+
+//! The CircularQueueStatus enum is returned by the try operations of the
+//! CircularQueue, which report a full, empty or shutdown queue as a value
+//! rather than an exception.
+enum class CircularQueueStatus
+{
+  Ok,       /*!< The element was pushed or popped
+            */
+
+  Full,     /*!< There was no room for the element, the queue is unchanged
+            */
+
+  Empty,    /*!< There was no element to pop
+            */
+
+  Shutdown, /*!< The queue has been shutdown and the element can never be
+                 pushed or popped
+            */
+
+  Timeout   /*!< There was still no room for the element when the timeout
+                 expired
+            */
+};
+
+//! Assumed size of a cache line. Data written by different threads is kept
+//! this far apart so the threads do not invalidate each other's lines.
+constexpr std::size_t CacheLineSize = 64;
+
+//! \brief Base class that gives an over-aligned type an aligned operator new
+//!
+//! Before C++17 operator new only aligns to alignof (std::max_align_t), so a
+//! type with alignas (CacheLineSize) members allocated with new may start in
+//! the middle of a cache line and the members share the lines they were
+//! meant to have to themselves. A class that derives from 
+//! CacheAligned<itself> is allocated with posix_memalign instead, aligned to
+//! alignof (Derived).
+template <typename Derived>
+struct CacheAligned
+{
+  //! Allocate size bytes aligned to alignof (Derived)
+  //!
+  //! \throw std::bad_alloc Raise std::bad_alloc if the memory can not be 
+  //! allocated
+  static void*
+  operator new (std::size_t size)
+    throw (std::bad_alloc);
+
+  //! Allocate size bytes aligned to alignof (Derived)
+  //!
+  //! \throw std::bad_alloc Raise std::bad_alloc if the memory can not be 
+  //! allocated
+  static void*
+  operator new[] (std::size_t size)
+    throw (std::bad_alloc);
+
+  //! Placement new, the class specific operator new would hide it otherwise
+  static void*
+  operator new (std::size_t size, void* where)
+    noexcept;
+
+  //! Release memory from operator new
+  static void
+  operator delete (void* ptr)
+    noexcept;
+
+  //! Release memory from operator new[]
+  static void
+  operator delete[] (void* ptr)
+    noexcept;
+
+  //! Matches placement new, there is nothing to release
+  static void
+  operator delete (void* ptr, void* where)
+    noexcept;
+
+private:
+  static void*
+  allocate (std::size_t size)
+    throw (std::bad_alloc);
+};
+
+//! Capacity template argument that selects a CircularQueue whose capacity is
+//! given to the constructor at runtime
+constexpr std::size_t DynamicCapacity = 0;
+
+//! The CircularQueueMemory enum controls where the buffer of a runtime 
+//! sized CircularQueue is allocated
+enum class CircularQueueMemory
+{
+  Heap,     /*!< The buffer is allocated with operator new
+            */
+
+  HugePages /*!< The buffer is mapped with mmap and backed by 2 MB huge 
+                 pages, either reserved hugetlbfs pages or transparent huge
+                 pages through madvise. Falls back to Heap when neither is
+                 available (or the platform is not Linux).
+            */
+};
+
+//! \brief Runtime capacity of a CircularQueue<T, DynamicCapacity>
+//!
+//! The buffer is allocated once, when the queue is constructed, and is never
+//! resized.
+struct CircularQueueCapacity
+{
+  //! The number of elements the queue can hold and where to allocate them
+  explicit
+  CircularQueueCapacity (std::size_t slots_,
+                         CircularQueueMemory memory_ = CircularQueueMemory::Heap)
+    noexcept;
+
+  std::size_t         slots;
+  CircularQueueMemory memory;
+};
+
+//! \brief Snapshot of the operational counters of a CircularQueue
+//!
+//! The counters are cumulative since the queue was constructed. They are 
+//! read one at a time without the queue lock, so a snapshot taken while the
+//! queue is busy may be a few operations apart from one counter to the next.
+struct CircularQueueStats
+{
+  //! Elements made visible to consumers
+  std::uint64_t pushes;
+  //! Elements removed by consumers
+  std::uint64_t pops;
+  //! Elements dropped by NonBlockingWrite to make room
+  std::uint64_t overwritten;
+  //! Times a BlockOnWrite producer waited on a full queue
+  std::uint64_t fullWaits;
+  //! Times a consumer waited on an empty queue
+  std::uint64_t emptyWaits;
+  //! Total nanoseconds producers spent waiting for room
+  std::uint64_t producerWaitNs;
+  //! Total nanoseconds consumers spent waiting for an element
+  std::uint64_t consumerWaitNs;
+  //! Largest number of elements the queue has held
+  std::uint64_t highWaterMark;
+  //! Times a thread found the queue lock held by another thread
+  std::uint64_t lockContended;
+  //! The maximum number of elements the queue can hold
+  std::uint64_t capacity;
+};
+
+//! Write stats in the Prometheus text exposition format, one cdn_queue_* 
+//! metric per counter labelled with queue="name". When several queues are
+//! written to one exposition only the first should pass withHelp, the 
+//! format allows a single HELP and TYPE line per metric.
+void
+writePrometheus (std::ostream&, 
+                 const std::string& name, 
+                 const CircularQueueStats& stats,
+                 bool withHelp = true);
+
+//! \brief A view of count contiguous elements starting at data
+//!
+//! CircularQueue hands these out for elements that stay in the queue's slots,
+//! the span is only valid for as long as the object that handed it out.
+template <typename T>
+class CircularQueueSpan
+{
+public:
+  //! An empty span
+  CircularQueueSpan ()
+    noexcept;
+
+  //! count elements starting at data
+  CircularQueueSpan (T* data, std::size_t count)
+    noexcept;
+
+  //! The first element
+  T*
+  data ()
+    const
+    noexcept;
+
+  //! Number of elements
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! True if there are no elements
+  bool
+  empty ()
+    const
+    noexcept;
+
+  //! The first element
+  T*
+  begin ()
+    const
+    noexcept;
+
+  //! One past the last element
+  T*
+  end ()
+    const
+    noexcept;
+
+  //! The element idx
+  T&
+  operator[] (std::size_t idx)
+    const
+    noexcept;
+
+private:
+  T*          m_data;
+  std::size_t m_count;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "CircularQueueTypes.icc"
+
+#endif // #ifndef CDN_CIRCULAR_QUEUE_TYPES_INCLUDED
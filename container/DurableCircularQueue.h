@@ -0,0 +1,406 @@
+// DurableCircularQueue.h
+//
+#ifndef CDN_DURABLE_CIRCULAR_QUEUE_INCLUDED
+#define CDN_DURABLE_CIRCULAR_QUEUE_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+// TODO: dependency on DataGuard
+#include "DataGuard.h"
+
+// TODO: dependency on FutexCondition
+#include "FutexCondition.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! The JournalFlushPolicy enum controls when a DurableCircularQueue forces
+//! its file to disk
+enum class JournalFlushPolicy
+{
+  None,     /*!< Never, the kernel writes the file back in its own time. The
+                 header is rewritten on every push and pop, so everything
+                 survives the process crashing but not the machine.
+            */
+
+  Periodic, /*!< A push syncs the file once the interval has passed since the
+                 last sync. The pushes of at most one interval are lost if the
+                 machine goes down, while pushes keep coming.
+            */
+
+  Batch     /*!< Sync once batch elements have been pushed since the last
+                 sync. A pushRange is counted at its end, so a long range
+                 costs a single sync. A batch of 1 makes every push durable
+                 before it returns.
+            */
+};
+
+//! \brief When a DurableCircularQueue forces its file to disk
+struct JournalFlush
+{
+  //! interval is only used by JournalFlushPolicy::Periodic and batch by
+  //! JournalFlushPolicy::Batch
+  explicit
+  JournalFlush (JournalFlushPolicy policy_ = JournalFlushPolicy::None,
+                std::chrono::milliseconds interval_ = std::chrono::milliseconds (10),
+                std::size_t batch_ = 1)
+    noexcept;
+
+  JournalFlushPolicy        policy;
+  std::chrono::milliseconds interval;
+  std::size_t               batch;
+};
+
+//! \brief The DurableCircularQueue class is a thread-safe CircularQueue kept
+//! in a memory-mapped file, so its elements survive a restart
+//!
+//! The file holds a header page followed by the slots. Elements are copied
+//! straight into the mapped slots, no system call is made for a push or a
+//! pop unless the JournalFlush asks for a sync. When the queue is
+//! constructed on an existing file the head and tail are recovered from the
+//! header and the elements still on it are popped first, recovered tells how
+//! many there were.
+//!
+//! The header is kept twice, each copy with a sequence number and a
+//! checksum, and a write goes to the older copy. A write torn by a crash
+//! fails its checksum and the other copy, one write older, is used. When the
+//! file is synced the new slots are written to disk before the header that
+//! covers them, so a header on disk never points at slots that are not. An
+//! element lost in a crash is one the push had not yet made durable, an
+//! element popped since the last header write is popped again.
+//!
+//! Opening a file written for a different T, capacity, mode or layout
+//! version raises CircularQueueError, as does a file another
+//! DurableCircularQueue has open.
+//!
+//! All operations take one mutex, like PriorityCircularQueue, and a sync is
+//! done with it held. T must be
+//! <a href="http://en.cppreference.com/w/cpp/types/is_trivially_copyable">TriviallyCopyable</a>
+//! and must not hold pointers, a restarted process reads it back from the
+//! file.
+//!
+template <typename T>
+class DurableCircularQueue
+{
+  static_assert (std::is_trivially_copyable<T>::value,
+                 "DurableCircularQueue elements are written to a file and must be trivially copyable");
+  static_assert (alignof (T) <= CacheLineSize,
+                 "DurableCircularQueue elements can not be aligned beyond a cache line");
+
+  struct State;
+  typedef thread::DataGuard<State> Guard;
+
+public:
+
+  //! Version of the file layout, bumped whenever it changes
+  static constexpr std::uint32_t LayoutVersion = 1;
+
+  //! Open the queue kept in the file at path, creating it with room for
+  //! capacity elements if it does not exist
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if capacity is zero,
+  //! the file can not be created, opened or mapped, is in use, has a header
+  //! that fails its checksum or was written for a different T, capacity,
+  //! mode or layout version
+  DurableCircularQueue (const std::string& path,
+                        const CircularQueueMode& mode,
+                        std::size_t capacity,
+                        const JournalFlush& flush = JournalFlush ())
+    throw (CircularQueueError);
+
+  //! Sync the file, unless the policy is JournalFlushPolicy::None, and close
+  //! it. The elements still on the queue stay in the file.
+  ~DurableCircularQueue ();
+
+  //! = delete
+  DurableCircularQueue (const DurableCircularQueue&) = delete;
+  //! = delete
+  DurableCircularQueue& operator= (const DurableCircularQueue&) = delete;
+
+  //! = delete
+  DurableCircularQueue (DurableCircularQueue&&) = delete;
+  //! = delete
+  DurableCircularQueue& operator= (DurableCircularQueue&&) = delete;
+
+  //! Return true if there are no elements available to be popped
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  bool
+  isEmpty ()
+    const
+    throw (CircularQueueError);
+
+  //! Number of elements available to be popped from the queue
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  std::size_t
+  size ()
+    const
+    throw (CircularQueueError);
+
+  //! The maximum number of elements the queue can hold
+  std::size_t
+  max ()
+    const
+    noexcept;
+
+  //! Number of elements found in the file when the queue was opened
+  std::size_t
+  recovered ()
+    const
+    noexcept;
+
+  //! Tell the queue to shutdown, this will force any blocking push or pop to
+  //! return. Not recorded in the file.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  void
+  shutdown ()
+    throw (CircularQueueError);
+
+  //! Return true if the queue has been shutdown
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  bool
+  isShutdown ()
+    const
+    throw (CircularQueueError);
+
+  //! Construct the element in place at the tail of the queue, potentially
+  //! waiting for space based upon the mode, and sync as the JournalFlush
+  //! asks
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full
+  //! in FailOnWrite mode, on mutex error, if the T constructor throws or if
+  //! the file can not be synced
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue was
+  //! shutdown while waiting for space
+  template <typename... Args>
+  void
+  emplace (Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element onto the queue, see emplace
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the elements of [first, last) onto the queue under a single lock
+  //! acquisition, with the mode handling a full queue as in
+  //! CircularQueue::pushRange. The range is synced once, at its end.
+  //!
+  //! \return last, or in FailOnWrite mode the first element not inserted
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  template <typename InputIt>
+  InputIt
+  pushRange (InputIt first, InputIt last)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the front of the queue out and return it, waiting forever if the
+  //! queue contains no elements
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  T
+  pop ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the front of the queue out and return it, if there are no
+  //! available elements before the timeout expires an 'empty' optional<T>
+  //! will be returned
+  //!
+  //! \throw CircularQueueError See pop
+  //! \throw CircularQueueShutdown See pop
+  template <typename Rep, typename Period>
+  boost::optional<T>
+  pop (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the front of the queue into out without waiting
+  //!
+  //! \return true if an element was popped, false if the queue was empty
+  //!
+  //! \throw CircularQueueError See pop
+  //! \throw CircularQueueShutdown See pop
+  bool
+  tryPop (T& out)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Force the elements pushed so far and the cursors to disk now, whatever
+  //! the policy
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the file can not be synced
+  void
+  sync ()
+    throw (CircularQueueError);
+
+private:
+
+  //! \brief Internal type for one copy of the file header
+  //!
+  //! Only fixed width fields, the checksum covers everything before it.
+  struct Record
+  {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t elementSize;
+    std::uint32_t elementAlign;
+    std::uint32_t mode;
+    std::uint64_t capacity;
+    std::uint64_t sequence;
+    std::uint64_t head;
+    std::uint64_t tail;
+    std::uint64_t checksum;
+  };
+
+  static_assert (std::is_standard_layout<Record>::value && sizeof (Record) == 64,
+                 "The journal header must have a fixed layout");
+
+  //! \brief Internal type for the state data
+  //!
+  //! head and tail are free running counts of pops and pushes as in
+  //! CircularQueue. journalHead is the head last written to the header and
+  //! syncedTail the tail the slots were last synced up to.
+  struct State
+  {
+    State ();
+
+    std::uint64_t                         head;
+    std::uint64_t                         tail;
+    std::uint64_t                         journalHead;
+    std::uint64_t                         syncedTail;
+    std::uint64_t                         sequence;
+    // Pushes since the last sync, for JournalFlushPolicy::Batch
+    std::size_t                           unsynced;
+    std::chrono::steady_clock::time_point lastSync;
+    bool                                  isShutdown;
+    // Number of threads parked on m_notEmpty and m_notFull
+    std::size_t                           notEmptyWaiters;
+    std::size_t                           notFullWaiters;
+  };
+
+  // "cdnjrnl1"
+  static constexpr std::uint64_t Magic = 0x316c6e726a6e6463;
+
+  // The two header copies are a disk sector apart so one torn write can not
+  // reach both, the slots start on the next page
+  static constexpr std::size_t RecordStride = 512;
+  static constexpr std::size_t SlotsOffset = 4096;
+
+  // Lock the state
+  std::unique_lock<Guard>
+  acquire ()
+    const;
+
+  // Open or create the file and fill state from its header
+  void
+  open (State&)
+    throw (CircularQueueError);
+
+  template <typename InsertFunctor>
+  void
+  insert (InsertFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Wait for room at the tail according to the mode, false in FailOnWrite
+  // mode when the queue is full
+  bool
+  makeRoom (std::unique_lock<Guard>&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Before the tail slot is reused, the header on disk must not still count
+  // it as holding an element
+  void
+  releaseSlot (State&)
+    throw (CircularQueueError);
+
+  // Record count pushes and sync if the policy asks for it
+  void
+  pushed (State&, std::size_t count)
+    throw (CircularQueueError);
+
+  // Wake the consumers for count new elements
+  void
+  published (State&, std::size_t count)
+    noexcept;
+
+  template <typename WaitFunctor>
+  boost::optional<T>
+  popImpl (WaitFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Sync the new slots, then write and sync the header
+  void
+  flush (State&)
+    throw (CircularQueueError);
+
+  void
+  unmap ()
+    noexcept;
+
+  void
+  writeRecord (State&)
+    noexcept;
+
+  void
+  syncSlots (std::uint64_t from, std::uint64_t to)
+    throw (CircularQueueError);
+
+  void
+  syncRange (std::size_t offset, std::size_t bytes)
+    throw (CircularQueueError);
+
+  Record&
+  record (std::size_t copy)
+    noexcept;
+
+  T*
+  slot (std::uint64_t count)
+    noexcept;
+
+  static std::uint64_t
+  checksum (const Record&)
+    noexcept;
+
+  const std::string       m_path;
+  const CircularQueueMode m_mode;
+  const std::size_t       m_capacity;
+  const JournalFlush      m_flush;
+  const std::size_t       m_pageSize;
+  int                     m_fd;
+  char*                   m_region;
+  std::size_t             m_regionBytes;
+  std::size_t             m_recovered;
+  mutable Guard           m_state;
+  thread::FutexCondition  m_notEmpty;
+  thread::FutexCondition  m_notFull;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "DurableCircularQueue.icc"
+
+#endif // #ifndef CDN_DURABLE_CIRCULAR_QUEUE_INCLUDED
@@ -0,0 +1,183 @@
+// LatencyHistogram.h
+//
+#ifndef CDN_LATENCY_HISTOGRAM_INCLUDED
+#define CDN_LATENCY_HISTOGRAM_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief Log-linear (HDR style) histogram of nanosecond durations
+//!
+//! Every power of two range is split into SubBuckets linear buckets, so a
+//! recorded value is known to within 1/SubBuckets (about 3%) of itself over
+//! the whole 64 bit range, in a fixed size array. Recording is a count of
+//! leading zeros, a shift and an increment, it never allocates.
+//!
+//! LatencyHistogram is not thread-safe, CircularQueue guards the one it keeps
+//! and hands out copies.
+//!
+class LatencyHistogram
+{
+public:
+
+  //! log2 of SubBuckets
+  static constexpr std::size_t SubBucketBits = 5;
+  //! Number of linear buckets per power of two
+  static constexpr std::size_t SubBuckets    = std::size_t (1) << SubBucketBits;
+  //! Total number of buckets covering the 64 bit range
+  static constexpr std::size_t Buckets       = (64 - SubBucketBits + 1) * SubBuckets;
+
+  //! An empty histogram
+  LatencyHistogram ()
+    noexcept;
+
+  //! Add one duration of ns nanoseconds
+  void
+  record (std::uint64_t ns)
+    noexcept;
+
+  //! Add every duration recorded in rhs
+  void
+  merge (const LatencyHistogram& rhs)
+    noexcept;
+
+  //! Forget every recorded duration
+  void
+  reset ()
+    noexcept;
+
+  //! Number of recorded durations
+  std::uint64_t
+  count ()
+    const
+    noexcept;
+
+  //! Smallest recorded duration, zero if nothing was recorded
+  std::uint64_t
+  min ()
+    const
+    noexcept;
+
+  //! Largest recorded duration, zero if nothing was recorded
+  std::uint64_t
+  max ()
+    const
+    noexcept;
+
+  //! Mean of the recorded durations, zero if nothing was recorded
+  double
+  mean ()
+    const
+    noexcept;
+
+  //! The duration that pct percent (0 to 100) of the recorded durations are
+  //! at or below, reported as the top of its bucket and never more than max.
+  //! Zero if nothing was recorded.
+  std::uint64_t
+  percentile (double pct)
+    const
+    noexcept;
+
+  //! The bucket a duration of ns nanoseconds is counted in
+  static std::size_t
+  bucketOf (std::uint64_t ns)
+    noexcept;
+
+  //! The largest duration counted in bucket
+  static std::uint64_t
+  bucketTop (std::size_t bucket)
+    noexcept;
+
+private:
+
+  std::array<std::uint64_t, Buckets> m_counts;
+  std::uint64_t                      m_count;
+  std::uint64_t                      m_min;
+  std::uint64_t                      m_max;
+  // the mean is kept in floating point so summing large durations can not
+  // overflow
+  double                             m_sum;
+};
+
+//! \brief CircularQueue latency policy that records nothing, the default
+struct NoLatencyTracking { };
+
+//! \brief CircularQueue latency policy that records how long every popped
+//! element sat on the queue in a LatencyHistogram
+struct TrackLatency { };
+
+//! \brief Per queue state of a latency policy, CircularQueue's bookkeeping
+//! derives from it
+//!
+//! stamp is called with the slot of every element made visible to consumers
+//! and record with the slot of every element popped from the queue. Elements
+//! dropped by NonBlockingWrite are never recorded.
+template <typename Policy>
+class LatencyRecorder;
+
+//! \brief NoLatencyTracking keeps no state and does nothing, an empty base
+//! class costs no space
+template <>
+class LatencyRecorder<NoLatencyTracking>
+{
+public:
+  explicit
+  LatencyRecorder (std::size_t /* slots */)
+  { }
+
+  void
+  stamp (std::size_t /* idx */)
+    noexcept
+  { }
+
+  void
+  record (std::size_t /* idx */)
+    noexcept
+  { }
+};
+
+//! \brief TrackLatency keeps a push time per slot and the histogram
+template <>
+class LatencyRecorder<TrackLatency>
+{
+public:
+  //! \throw std::bad_alloc Raise std::bad_alloc if the push times can not be
+  //! allocated
+  explicit
+  LatencyRecorder (std::size_t slots);
+
+  //! Remember now as the push time of slot idx
+  void
+  stamp (std::size_t idx)
+    noexcept;
+
+  //! Add the time since slot idx was stamped to the histogram
+  void
+  record (std::size_t idx)
+    noexcept;
+
+  //! The durations recorded so far
+  LatencyHistogram&
+  histogram ()
+    noexcept;
+
+private:
+  std::vector<std::int64_t> m_pushedNs;
+  LatencyHistogram          m_histogram;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "LatencyHistogram.icc"
+
+#endif // #ifndef CDN_LATENCY_HISTOGRAM_INCLUDED
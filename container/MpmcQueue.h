@@ -0,0 +1,239 @@
+// MpmcQueue.h
+//
+#ifndef CDN_MPMC_QUEUE_INCLUDED
+#define CDN_MPMC_QUEUE_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+// TODO: dependency on EventCount
+#include "EventCount.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief The MpmcQueue class is a bounded lock-free multi-producer/
+//! multi-consumer variant of CircularQueue
+//!
+//! MpmcQueue has the same FIFO ordering and the same push/emplace/pop/shutdown
+//! surface as CircularQueue and any number of threads may push and pop 
+//! concurrently. Every slot carries a sequence number that tells producers
+//! and consumers whether the slot is free or holds a published element, so 
+//! claiming a slot is a single compare-and-swap on the shared enqueue or 
+//! dequeue cursor and no mutex is ever taken on the hot path. Threads are 
+//! only parked when they have to wait (an empty queue on pop, or a full queue
+//! in BlockOnWrite mode).
+//!
+//! The CircularQueueMode semantics:
+//!  - FailOnWrite raises CircularQueueError when the queue is full
+//!  - BlockOnWrite makes the producer wait for room
+//!  - NonBlockingWrite makes the producer discard the oldest element to make 
+//!    room for the new one
+//!
+//! isEmpty and size are a snapshot that may already be stale when they 
+//! return, size also counts elements that are still being constructed.
+//!
+//! At a minimum T must meet the requirements of 
+//! <a href="http://en.cppreference.com/w/cpp/concept/MoveConstructible">MoveConstructible</a> and 
+//! <a href="http://en.cppreference.com/w/cpp/concept/Destructible">Destructible</a>.
+//! Elements are only constructed when pushed and destroyed when popped, so T
+//! does not need to be DefaultConstructible.
+//!
+//! The cursors and the cells are cache line aligned, MpmcQueue derives from
+//! CacheAligned so a queue created with new is aligned as well.
+//!
+template <typename T, std::size_t N>
+class MpmcQueue
+  : public CacheAligned<MpmcQueue<T, N>>
+{
+  static_assert (N > 0, "MpmcQueue requires a capacity of at least one element");
+
+public:
+
+  //! No elements are constructed until they are pushed
+  explicit
+  MpmcQueue (const CircularQueueMode&)
+    noexcept;
+
+  //! Destroy any elements that were never popped
+  ~MpmcQueue ();
+
+  //! = delete
+  MpmcQueue (const MpmcQueue&) = delete;
+  //! = delete
+  MpmcQueue& operator= (const MpmcQueue&) = delete;
+
+  //! = delete
+  MpmcQueue (MpmcQueue&&) = delete;
+  //! = delete
+  MpmcQueue& operator= (MpmcQueue&&) = delete;
+
+  //! Return true if there are no elements available to be popped
+  bool
+  isEmpty ()
+    const
+    noexcept;
+
+  //! Number of elements in the queue, including elements being pushed
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! The maximum number of element the Queue can hold
+  std::size_t
+  max ()
+    const
+    noexcept;
+
+  //! Tell the queue to shutdown, this will force any blocking push or pop to
+  //! return
+  void
+  shutdown ()
+    noexcept;
+
+  //! Return true if the queue has been shutdown
+  bool
+  isShutdown ()
+    const
+    noexcept;
+
+  //! Construct the element in place at the tail of the queue, potentially 
+  //! waiting for space based upon the mode
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full 
+  //! in FailOnWrite mode, on mutex error or if the T constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  template <typename... Args>
+  void
+  emplace (Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element onto the queue, potentially waiting for space based upon
+  //! the mode
+  //!
+  //! T must support
+  //! <a href="http://en.cppreference.com/w/cpp/concept/CopyConstructible">CopyConstructible</a>
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full 
+  //! in FailOnWrite mode, on mutex error or if the T copy constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  void
+  push (const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the front of the queue out and return it, waiting forever if the 
+  //! queue contains no elements
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  T
+  pop ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the front of the queue out and return it, if there are no available
+  //! elements before the timeout expires an 'empty' optional<T> will be
+  //! returned
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  template <typename Rep, typename Period>
+  boost::optional<T>
+  pop (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+private:
+
+  // Keep the cursors each on their own cache line so producers and consumers
+  // do not invalidate each other's line on every claim
+  static constexpr std::size_t CacheLine = CacheLineSize;
+
+  typedef typename std::aligned_storage<sizeof (T), alignof (T)>::type Slot;
+
+  //! \brief Internal type for a slot and its sequence number
+  //!
+  //! sequence == pos          the slot is free for the producer of pos
+  //! sequence == pos + 1      the slot holds the element pushed at pos
+  //! sequence == pos + N      the slot was popped and is free for pos + N
+  struct Cell
+  {
+    std::atomic<std::size_t> sequence;
+    // false when the T constructor threw after the slot was claimed, the 
+    // consumer skips the slot instead of stalling on it
+    bool                     isConstructed;
+    Slot                     storage;
+  };
+
+  Cell&
+  cell (std::size_t)
+    noexcept;
+
+  const Cell&
+  cell (std::size_t)
+    const
+    noexcept;
+
+  bool
+  isReadable ()
+    const
+    noexcept;
+
+  bool
+  isWritable ()
+    const
+    noexcept;
+
+  bool
+  claimWrite (std::size_t&)
+    noexcept;
+
+  bool
+  claimRead (std::size_t&)
+    noexcept;
+
+  void
+  release (std::size_t)
+    noexcept;
+
+  void
+  makeRoom ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  bool
+  tryTake (boost::optional<T>&)
+    throw (CircularQueueError);
+
+  const CircularQueueMode  m_mode;
+  std::atomic<bool>        m_isShutdown;
+  thread::EventCount       m_notEmpty;
+  thread::EventCount       m_notFull;
+
+  alignas (CacheLine) std::atomic<std::size_t> m_enqueuePos;
+  alignas (CacheLine) std::atomic<std::size_t> m_dequeuePos;
+  alignas (CacheLine) Cell                     m_cells[N];
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "MpmcQueue.icc"
+
+#endif // #ifndef CDN_MPMC_QUEUE_INCLUDED
@@ -0,0 +1,348 @@
+// PriorityCircularQueue.h
+//
+#ifndef CDN_PRIORITY_CIRCULAR_QUEUE_INCLUDED
+#define CDN_PRIORITY_CIRCULAR_QUEUE_INCLUDED
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+// TODO: dependency on DataGuard
+#include "DataGuard.h"
+
+// TODO: dependency on FutexCondition
+#include "FutexCondition.h"
+
+#include "RingStorage.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief Configuration of one lane of a PriorityCircularQueue
+struct PriorityLane
+{
+  //! A lane of capacity.slots elements that handles a full ring according to
+  //! mode. weight is only used by PriorityService::Weighted.
+  PriorityLane (const CircularQueueMode& mode_,
+                const CircularQueueCapacity& capacity_,
+                std::size_t weight_ = 1)
+    noexcept;
+
+  CircularQueueMode     mode;
+  CircularQueueCapacity capacity;
+  std::size_t           weight;
+};
+
+//! The PriorityService enum controls how a PriorityCircularQueue picks the
+//! lane a pop is served from
+enum class PriorityService
+{
+  Strict,  /*!< Always the highest priority lane that holds an element, a
+                busy high lane can starve the lower ones
+           */
+
+  Weighted /*!< Service is given in rounds, in every round each lane is
+                served up to its weight in elements, highest priority first.
+                A backlogged lane is guaranteed its weight out of the sum of
+                the weights of the backlogged lanes, so the low lanes keep
+                moving. Lanes that are empty give up their share for the
+                round.
+           */
+};
+
+//! \brief The PriorityCircularQueue class is a thread-safe queue with Lanes
+//! fixed priority lanes
+//!
+//! Every lane is a bounded ring with its own capacity and CircularQueueMode,
+//! lane 0 has the highest priority. An element is pushed onto a given lane
+//! and pop serves the highest priority lane that holds an element, FIFO
+//! within the lane, so control messages do not wait behind bulk data.
+//! PriorityService::Weighted bounds how long the lower lanes can be starved.
+//!
+//! All lanes are guarded by one mutex and consumers wait on one condition
+//! whichever lane they are waiting for, a push onto any lane wakes them.
+//! BlockOnWrite producers wait on their own lane. As with CircularQueue a
+//! notify is only made when a thread is parked.
+//!
+//! At a minimum T must meet the requirements of
+//! <a href="http://en.cppreference.com/w/cpp/concept/Destructible">Destructible</a> and
+//! <a href="http://en.cppreference.com/w/cpp/concept/MoveConstructible">MoveConstructible</a>.
+//!
+template <typename T, std::size_t Lanes>
+class PriorityCircularQueue
+{
+  static_assert (Lanes > 0, "PriorityCircularQueue requires at least one lane");
+
+  struct State;
+  typedef thread::DataGuard<State> Guard;
+
+public:
+
+  //! The type returned by pop, see CircularQueue::pop_type
+  typedef typename std::conditional<std::is_move_constructible<T>::value,
+                                    T,
+                                    const T>::type pop_type;
+
+  //! Allocate the buffer of every lane, lanes[0] is the highest priority
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if a lane has a
+  //! capacity of zero slots or a weight of zero, on mutex error or if a
+  //! buffer can not be allocated
+  explicit
+  PriorityCircularQueue (const std::array<PriorityLane, Lanes>& lanes,
+                         PriorityService service = PriorityService::Strict)
+    throw (CircularQueueError);
+
+  //! Destroy the elements still on the queue
+  ~PriorityCircularQueue () = default;
+
+  //! = delete
+  PriorityCircularQueue (const PriorityCircularQueue&) = delete;
+  //! = delete
+  PriorityCircularQueue& operator= (const PriorityCircularQueue&) = delete;
+
+  //! = delete
+  PriorityCircularQueue (PriorityCircularQueue&&) = delete;
+  //! = delete
+  PriorityCircularQueue& operator= (PriorityCircularQueue&&) = delete;
+
+  //! Return true if no lane holds an element
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  bool
+  isEmpty ()
+    const
+    throw (CircularQueueError);
+
+  //! Number of elements on all lanes
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  std::size_t
+  size ()
+    const
+    throw (CircularQueueError);
+
+  //! Number of elements on lane
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! lane or on mutex error
+  std::size_t
+  size (std::size_t lane)
+    const
+    throw (CircularQueueError);
+
+  //! The number of elements lane can hold
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! lane
+  std::size_t
+  max (std::size_t lane)
+    const
+    throw (CircularQueueError);
+
+  //! Tell the queue to shutdown, this will force any blocking push or pop to
+  //! return
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  void
+  shutdown ()
+    throw (CircularQueueError);
+
+  //! Return true if the queue has been shutdown
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  bool
+  isShutdown ()
+    const
+    throw (CircularQueueError);
+
+  //! Construct the element in place on lane from args, potentially waiting
+  //! for space based upon the mode of the lane
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no such
+  //! lane, the lane is full in FailOnWrite mode, on mutex error or if the T
+  //! constructor throws, the queue is left unchanged
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  template <typename... Args>
+  void
+  emplace (std::size_t lane, Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element onto lane, potentially waiting for space based upon
+  //! the mode of the lane
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (std::size_t lane, const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the element onto lane, potentially waiting for space based upon
+  //! the mode of the lane
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (std::size_t lane, T&&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop the front of the lane picked by the PriorityService, waiting
+  //! forever if no lane holds an element
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move/copy constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue has
+  //! been shutdown
+  pop_type
+  pop ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop the front of the lane picked by the PriorityService, if no lane
+  //! holds an element before the timeout expires an 'empty' optional<T> will
+  //! be returned
+  //!
+  //! \throw CircularQueueError See pop
+  //! \throw CircularQueueShutdown See pop
+  template <typename Rep, typename Period>
+  boost::optional<pop_type>
+  pop (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Pop the front of the lane picked by the PriorityService without
+  //! waiting, the element is move assigned into out and the lane it came
+  //! from into lane
+  //!
+  //! \return true if an element was popped, false if every lane was empty
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move/copy assignment operator throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  bool
+  tryPop (T& out, std::size_t& lane)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+private:
+
+  // Lock the state
+  std::unique_lock<Guard>
+  acquire ()
+    const;
+
+  template <typename InsertFunctor>
+  void
+  insert (std::size_t lane, InsertFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Wait for an element on any lane and hand the lane picked by the
+  // PriorityService to popFunctor, with the lock held. Returns false on
+  // timeout.
+  template <typename PopFunctor, typename WaitFunctor>
+  bool
+  popImpl (PopFunctor, WaitFunctor)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  // Move the front element of lane out with extract, then destroy it and
+  // wake a producer waiting on the lane
+  template <typename Extract>
+  void
+  take (State&, std::size_t lane, Extract);
+
+  //! \brief Internal type for one lane
+  //!
+  //! head and tail are free running counts of pops and pushes as in
+  //! CircularQueue, credit is what is left of the lane's weight in the
+  //! current Weighted round.
+  struct Lane
+  {
+    explicit
+    Lane (const PriorityLane& config)
+      : mode (config.mode),
+        weight (config.weight),
+        credit (config.weight),
+        head (0),
+        tail (0),
+        notFullWaiters (0),
+        buffer (config.capacity)
+    { }
+
+    ~Lane ()
+    {
+      for (auto pos = head; pos != tail; ++pos)
+      {
+        buffer.destroy (buffer.index (pos));
+      }
+    }
+
+    Lane (const Lane&) = delete;
+    Lane& operator= (const Lane&) = delete;
+
+    bool
+    isEmpty ()
+      const
+      noexcept
+    { return head == tail; }
+
+    bool
+    isFull ()
+      const
+      noexcept
+    { return tail - head == buffer.capacity (); }
+
+    CircularQueueMode                  mode;
+    std::size_t                        weight;
+    std::size_t                        credit;
+    std::uint64_t                      head;
+    std::uint64_t                      tail;
+    // Number of producers parked on the lane's notFull
+    std::size_t                        notFullWaiters;
+    RingStorage<T, DynamicCapacity>    buffer;
+  };
+
+  //! \brief Internal type for the state data
+  struct State
+  {
+    State (const std::array<PriorityLane, Lanes>& config,
+           PriorityService service_);
+
+    // The lane the next pop is served from, Lanes if every lane is empty
+    std::size_t
+    pick ()
+      noexcept;
+
+    std::array<std::unique_ptr<Lane>, Lanes> lanes;
+    PriorityService                          service;
+    std::size_t                              count;
+    bool                                     isShutdown;
+    // Number of consumers parked on m_notEmpty
+    std::size_t                              notEmptyWaiters;
+  };
+
+  // Immutable after construction so max can read it without the lock
+  std::array<std::size_t, Lanes>             m_capacity;
+  mutable Guard                              m_state;
+  thread::FutexCondition                     m_notEmpty;
+  std::array<thread::FutexCondition, Lanes>  m_notFull;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "PriorityCircularQueue.icc"
+
+#endif // #ifndef CDN_PRIORITY_CIRCULAR_QUEUE_INCLUDED
@@ -0,0 +1,196 @@
+// QueueSet.h
+//
+#ifndef CDN_QUEUE_SET_INCLUDED
+#define CDN_QUEUE_SET_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+// TODO: dependency on EventCount
+#include "EventCount.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+template <typename T, std::size_t N, typename Latency, typename Wait>
+class CircularQueue;
+
+//! The QueueSetOrder enum controls which queue QueueSet::select reports when
+//! several of them hold elements
+enum class QueueSetOrder
+{
+  RoundRobin, /*!< Start looking after the queue reported last, so a busy
+                   queue can not starve the others
+              */
+
+  Priority    /*!< Always report the lowest numbered queue, add the queues
+                   most important first
+              */
+};
+
+//! \brief The QueueSet class waits on several CircularQueues at once
+//!
+//! A consumer that serves many queues adds them to a QueueSet and calls
+//! select, which blocks until any of them holds an element and returns the
+//! number add gave that queue. The queues can hold different element types.
+//!
+//! A queue tells its set when it goes from empty to not empty, by setting
+//! its bit in a ready mask and notifying an EventCount, so select never
+//! locks the queues. A queue whose bit is set is checked against its push
+//! and pop counters, without its lock, before it is reported, and stays
+//! ready until a later select finds it empty. A queue that is shutdown is
+//! reported while it still holds elements and then once more, popping from
+//! it then reports the shutdown, after which the set skips it.
+//!
+//! The queue was not empty when select looked at it, but with more than one
+//! consumer another thread can pop first, so pop with tryPop or popAll
+//! rather than a blocking pop.
+//!
+//! add and remove must not run concurrently with select. A queue belongs to
+//! at most one set. Destroying the set removes every queue still in it, 
+//! and a queue destroyed while in a set removes itself, which counts as a
+//! remove.
+//!
+class QueueSet final
+{
+public:
+  //! The maximum number of queues in a set
+  static constexpr std::size_t MaxQueues = 64;
+
+  //! An empty set
+  explicit
+  QueueSet (QueueSetOrder order = QueueSetOrder::RoundRobin)
+    noexcept;
+
+  //! Remove the queues still in the set
+  ~QueueSet ();
+
+  //! = delete
+  QueueSet (const QueueSet&) = delete;
+  //! = delete
+  QueueSet& operator= (const QueueSet&) = delete;
+
+  //! = delete
+  QueueSet (QueueSet&&) = delete;
+  //! = delete
+  QueueSet& operator= (QueueSet&&) = delete;
+
+  //! Add queue to the set, a queue that already holds elements is ready
+  //! straight away
+  //!
+  //! \return The number select reports for queue, the lowest free one
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the set already
+  //! holds MaxQueues queues, queue already belongs to a set or on mutex error
+  template <typename T, std::size_t N, typename Latency, typename Wait>
+  std::size_t
+  add (CircularQueue<T, N, Latency, Wait>& queue)
+    throw (CircularQueueError);
+
+  //! Remove the queue add numbered idx, the number is free for reuse
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if there is no queue
+  //! idx or on mutex error
+  void
+  remove (std::size_t idx)
+    throw (CircularQueueError);
+
+  //! Number of queues in the set
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! Wait forever for a queue to hold an element or be shutdown
+  //!
+  //! \return The number of the queue
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  std::size_t
+  select ()
+    throw (CircularQueueError);
+
+  //! Wait for a queue to hold an element or be shutdown, if none does before
+  //! the timeout expires an 'empty' optional is returned
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error
+  template <typename Rep, typename Period>
+  boost::optional<std::size_t>
+  select (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError);
+
+private:
+  template <typename, std::size_t, typename, typename>
+  friend class CircularQueue;
+
+  //! \brief Internal type for a queue in the set, the queue type is erased
+  //! behind two plain function pointers
+  struct Entry
+  {
+    void* queue;
+    bool (*hasElement) (const void*);
+    void (*leave) (void*);
+  };
+
+  template <typename Queue>
+  static bool
+  hasElementOf (const void* queue)
+    noexcept;
+
+  template <typename Queue>
+  static void
+  leaveOf (void* queue);
+
+  // Called by a queue in the set, with its lock held, when it goes from
+  // empty to not empty and when it is shutdown
+  void
+  ready (std::size_t idx)
+    noexcept;
+
+  void
+  closed (std::size_t idx)
+    noexcept;
+
+  // The number of a ready queue in the select order, MaxQueues if none
+  std::size_t
+  pick ()
+    noexcept;
+
+  bool
+  anyReady ()
+    const
+    noexcept;
+
+  const QueueSetOrder             m_order;
+  std::array<Entry, MaxQueues>    m_entries;
+  // Only changed by add and remove
+  std::uint64_t                   m_used;
+  // Set by the queues, cleared by select once a queue is found empty
+  std::atomic<std::uint64_t>      m_ready;
+  // Set when a queue is shutdown, cleared once select has reported it empty
+  // or by remove
+  std::atomic<std::uint64_t>      m_closed;
+  // Where RoundRobin starts looking
+  std::atomic<std::size_t>        m_next;
+  thread::EventCount              m_event;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "QueueSet.icc"
+
+#endif // #ifndef CDN_QUEUE_SET_INCLUDED
@@ -0,0 +1,227 @@
+// RingStorage.h
+//
+#ifndef CDN_RING_STORAGE_INCLUDED
+#define CDN_RING_STORAGE_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief Maps a free running position onto a slot index of a ring of N slots
+//!
+//! A power of two N is a mask, anything else is a modulo (which the compiler
+//! still turns into a multiply and shift for a constant N).
+template <std::size_t N, bool = (N != 0 && (N & (N - 1)) == 0)>
+struct RingIndex
+{
+  static constexpr std::size_t
+  slot (std::uint64_t pos)
+    noexcept
+  { return static_cast<std::size_t> (pos % N); }
+};
+
+//! \brief RingIndex for a power of two N
+template <std::size_t N>
+struct RingIndex<N, true>
+{
+  static constexpr std::size_t
+  slot (std::uint64_t pos)
+    noexcept
+  { return static_cast<std::size_t> (pos & (N - 1)); }
+};
+
+//! \brief The RingStorage class is the slot buffer behind CircularQueue
+//!
+//! The slots are raw, suitably aligned storage. Nothing is constructed when
+//! the RingStorage is created, elements are constructed in place with 
+//! construct and destroyed with destroy, so creating even a very large ring
+//! is O(1) and a page of the buffer is only touched once a slot on it is 
+//! used. RingStorage does not know which slots hold an element, the owner
+//! must destroy the live elements before the RingStorage goes away.
+//!
+//! The primary template holds the N slots inline. The DynamicCapacity 
+//! specialization allocates its buffer once at construction (see 
+//! CircularQueueCapacity) and never resizes it.
+//!
+//! RingStorage is not thread-safe, CircularQueue guards it.
+//!
+template <typename T, std::size_t N>
+class RingStorage
+{
+public:
+
+  //! No slots are constructed
+  RingStorage ()
+    noexcept;
+
+  //! = default
+  ~RingStorage () = default;
+
+  //! = delete
+  RingStorage (const RingStorage&) = delete;
+  //! = delete
+  RingStorage& operator= (const RingStorage&) = delete;
+
+  //! = delete
+  RingStorage (RingStorage&&) = delete;
+  //! = delete
+  RingStorage& operator= (RingStorage&&) = delete;
+
+  //! The number of slots
+  constexpr std::size_t
+  capacity ()
+    const
+    noexcept;
+
+  //! The slot a free running position maps onto
+  constexpr std::size_t
+  index (std::uint64_t pos)
+    const
+    noexcept;
+
+  //! Construct an element in the empty slot idx from args
+  //!
+  //! Anything thrown by the T constructor is passed on and the slot is left
+  //! empty
+  template <typename... Args>
+  T&
+  construct (std::size_t idx, Args&&... args);
+
+  //! Default initialize an element in the empty slot idx, members of 
+  //! trivial types are left uninitialized for the caller to fill in
+  T&
+  defaultConstruct (std::size_t idx);
+
+  //! Destroy the element in slot idx, leaving the slot empty
+  void
+  destroy (std::size_t idx)
+    noexcept;
+
+  //! Access the element in slot idx, the slot must hold an element
+  T&
+  operator[] (std::size_t idx)
+    noexcept;
+
+  //! Access the element in slot idx, the slot must hold an element
+  const T&
+  operator[] (std::size_t idx)
+    const
+    noexcept;
+
+private:
+
+  typedef typename std::aligned_storage<sizeof (T), alignof (T)>::type Slot;
+
+  Slot m_slots[N];
+};
+
+//! \brief RingStorage with a capacity chosen at runtime
+template <typename T>
+class RingStorage<T, DynamicCapacity>
+{
+public:
+
+  //! Allocate the buffer, no slots are constructed
+  //!
+  //! \throw std::bad_alloc Raise std::bad_alloc if the buffer can not be 
+  //! allocated
+  //! \throw CircularQueueError Raise CircularQueueError if the buffer size
+  //! does not fit in a std::size_t
+  explicit
+  RingStorage (const CircularQueueCapacity&);
+
+  //! Release the buffer
+  ~RingStorage ();
+
+  //! = delete
+  RingStorage (const RingStorage&) = delete;
+  //! = delete
+  RingStorage& operator= (const RingStorage&) = delete;
+
+  //! = delete
+  RingStorage (RingStorage&&) = delete;
+  //! = delete
+  RingStorage& operator= (RingStorage&&) = delete;
+
+  //! The number of slots
+  std::size_t
+  capacity ()
+    const
+    noexcept;
+
+  //! The slot a free running position maps onto, a mask when the capacity
+  //! is a power of two
+  std::size_t
+  index (std::uint64_t pos)
+    const
+    noexcept;
+
+  //! True if the buffer was mapped for huge pages, either from the hugetlbfs
+  //! pool or advised for transparent huge pages
+  bool
+  isHugePages ()
+    const
+    noexcept;
+
+  //! Construct an element in the empty slot idx from args
+  //!
+  //! Anything thrown by the T constructor is passed on and the slot is left
+  //! empty
+  template <typename... Args>
+  T&
+  construct (std::size_t idx, Args&&... args);
+
+  //! Default initialize an element in the empty slot idx, members of 
+  //! trivial types are left uninitialized for the caller to fill in
+  T&
+  defaultConstruct (std::size_t idx);
+
+  //! Destroy the element in slot idx, leaving the slot empty
+  void
+  destroy (std::size_t idx)
+    noexcept;
+
+  //! Access the element in slot idx, the slot must hold an element
+  T&
+  operator[] (std::size_t idx)
+    noexcept;
+
+  //! Access the element in slot idx, the slot must hold an element
+  const T&
+  operator[] (std::size_t idx)
+    const
+    noexcept;
+
+private:
+
+  void*
+  allocate (std::size_t bytes, CircularQueueMemory)
+    noexcept;
+
+  void
+  deallocate ()
+    noexcept;
+
+  T*          m_slots;
+  std::size_t m_capacity;
+  bool        m_isPowerOfTwo;
+  // zero when m_slots came from posix_memalign, otherwise the mmap length
+  std::size_t m_mappedBytes;
+  bool        m_isHugePages;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "RingStorage.icc"
+
+#endif // #ifndef CDN_RING_STORAGE_INCLUDED
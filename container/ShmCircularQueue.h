@@ -0,0 +1,363 @@
+// ShmCircularQueue.h
+//
+#ifndef CDN_SHM_CIRCULAR_QUEUE_INCLUDED
+#define CDN_SHM_CIRCULAR_QUEUE_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! The ShmQueueRole enum is the side of a ShmCircularQueue a process attaches
+//! as
+enum class ShmQueueRole
+{
+  Producer, /*!< The one process that may push/emplace
+            */
+
+  Consumer  /*!< The one process that may pop
+            */
+};
+
+//! \brief The ShmCircularQueue class is a single-producer/single-consumer
+//! CircularQueue shared between two processes
+//!
+//! The queue lives in a POSIX shared memory object (shm_open and mmap)
+//! named like "/feed". Whichever process gets there first creates and
+//! formats it, the other attaches to it, so the producer and the consumer
+//! can be started in either order. Elements are copied straight into the
+//! shared ring and out of it again, no system call is made while the other
+//! side is keeping up.
+//!
+//! As with SpscQueue the head and tail cursors are published with
+//! acquire/release atomics. A side that has to wait spins briefly and then
+//! sleeps on a process-shared futex word, the other side only makes the
+//! FUTEX_WAKE system call when somebody is actually asleep.
+//!
+//! The layout is fixed: a header of fixed width fields (a magic number, the
+//! layout version, sizeof and alignof T, the capacity and the mode) on its
+//! own cache line, the producer and consumer cursors on one cache line each,
+//! followed by the slots. Attaching with a different T, capacity or mode, or
+//! to a region written by a different layout version, raises
+//! CircularQueueError rather than misreading the ring.
+//!
+//! Every role records the pid of the process holding it. Attaching to a
+//! role whose process has died takes the role over, the elements already on
+//! the ring are kept. A peer that died is reported by peerCrashed, and
+//! isPeerAttached can be polled to notice a peer that dies later. A side
+//! that is waiting checks on its peer every PeerCheckMs and gives up with
+//! CircularQueueError once the peer has died. Liveness is checked with 
+//! kill (pid, 0), so a pid reused by an unrelated process looks alive. A
+//! producer that dies in the middle of a push loses that element, a 
+//! consumer that dies in the middle of a pop leaves it on the ring to be
+//! popped again.
+//!
+//! The shared memory object outlives both processes, remove it with unlink
+//! once neither needs it. A process that takes a role while no live process
+//! holds the other one starts a new session, a shutdown left behind by the
+//! earlier processes is cleared so restarted processes do not find the 
+//! queue shutdown. While the peer is alive its shutdown stands.
+//!
+//! T must be
+//! <a href="http://en.cppreference.com/w/cpp/types/is_trivially_copyable">TriviallyCopyable</a>,
+//! it is read by another process that can not run its constructors, and
+//! must not hold pointers into either process. The CircularQueueMode
+//! semantics are those of SpscQueue, NonBlockingWrite is not supported.
+//!
+//! Futexes are Linux only, elsewhere a waiting side polls with short sleeps.
+//!
+template <typename T>
+class ShmCircularQueue
+{
+  static_assert (std::is_trivially_copyable<T>::value,
+                 "ShmCircularQueue elements are shared between processes and must be trivially copyable");
+  static_assert (alignof (T) <= CacheLineSize,
+                 "ShmCircularQueue elements can not be aligned beyond a cache line");
+
+public:
+
+  //! Version of the shared memory layout, bumped whenever it changes
+  static constexpr std::uint32_t LayoutVersion = 1;
+
+  //! How often a waiting side checks that its peer is still alive
+  static constexpr std::chrono::milliseconds::rep PeerCheckMs = 100;
+
+  //! Create the shared memory object name with room for capacity elements,
+  //! or attach to it if it already exists, and take role
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if capacity is zero,
+  //! mode is NonBlockingWrite, the shared memory can not be created or
+  //! mapped, the existing queue has a different layout, T, capacity or mode,
+  //! or a live process already holds role
+  ShmCircularQueue (const std::string& name,
+                    ShmQueueRole role,
+                    const CircularQueueMode& mode,
+                    std::size_t capacity)
+    throw (CircularQueueError);
+
+  //! Give up the role and unmap the queue, the shared memory object and the
+  //! elements on it remain
+  ~ShmCircularQueue ();
+
+  //! = delete
+  ShmCircularQueue (const ShmCircularQueue&) = delete;
+  //! = delete
+  ShmCircularQueue& operator= (const ShmCircularQueue&) = delete;
+
+  //! = delete
+  ShmCircularQueue (ShmCircularQueue&&) = delete;
+  //! = delete
+  ShmCircularQueue& operator= (ShmCircularQueue&&) = delete;
+
+  //! Remove the shared memory object name, processes that have it mapped
+  //! keep using it. Does nothing if there is no such object.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the object can
+  //! not be removed
+  static void
+  unlink (const std::string& name)
+    throw (CircularQueueError);
+
+  //! Return true if there are no elements available to be popped
+  bool
+  isEmpty ()
+    const
+    noexcept;
+
+  //! Number of elements available to be popped from the queue
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! The maximum number of elements the queue can hold
+  std::size_t
+  max ()
+    const
+    noexcept;
+
+  //! Tell both processes the queue is shutdown, this will force any blocking
+  //! push or pop to return
+  void
+  shutdown ()
+    noexcept;
+
+  //! Return true if the queue has been shutdown
+  bool
+  isShutdown ()
+    const
+    noexcept;
+
+  //! True if, when this process attached, the process holding the other
+  //! role had died
+  bool
+  peerCrashed ()
+    const
+    noexcept;
+
+  //! True if a live process holds the other role right now
+  bool
+  isPeerAttached ()
+    const
+    noexcept;
+
+  //! Construct the element in place at the tail of the queue, potentially
+  //! waiting for space based upon the mode. Producer only.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if this process is
+  //! not the producer, the queue is full in FailOnWrite mode or the consumer
+  //! died while waiting for space
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  template <typename... Args>
+  void
+  emplace (Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element onto the queue, potentially waiting for space based
+  //! upon the mode. Producer only.
+  //!
+  //! \throw CircularQueueError See emplace
+  //! \throw CircularQueueShutdown See emplace
+  void
+  push (const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the front of the queue out and return it, waiting forever if the
+  //! queue contains no elements. Consumer only.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if this process is
+  //! not the consumer or the producer died while waiting for an element
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  T
+  pop ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the front of the queue out and return it, if there are no
+  //! available elements before the timeout expires an 'empty' optional<T>
+  //! will be returned. Consumer only.
+  //!
+  //! \throw CircularQueueError See pop
+  //! \throw CircularQueueShutdown See pop
+  template <typename Rep, typename Period>
+  boost::optional<T>
+  pop (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+private:
+
+  //! \brief Internal type for the start of the shared memory object
+  //!
+  //! Only fixed width fields, so the layout is the same in every process
+  //! built for the platform. A zero filled header reads as not ready.
+  struct Header
+  {
+    // Written once by the creating process, ready is set last
+    std::uint64_t              magic;
+    std::uint32_t              version;
+    std::uint32_t              elementSize;
+    std::uint32_t              elementAlign;
+    std::uint32_t              mode;
+    std::uint64_t              capacity;
+    std::atomic<std::uint32_t> ready;
+    std::atomic<std::uint32_t> creatorPid;
+    std::atomic<std::uint32_t> isShutdown;
+
+    // Producer side. tail is the free running count of pushes, the producer
+    // sleeps on notFullSeq.
+    alignas (CacheLineSize) std::atomic<std::uint64_t> tail;
+    std::atomic<std::uint32_t> producerPid;
+    std::atomic<std::uint32_t> notFullSeq;
+    std::atomic<std::uint32_t> notFullSleepers;
+
+    // Consumer side. head is the free running count of pops, the consumer
+    // sleeps on notEmptySeq.
+    alignas (CacheLineSize) std::atomic<std::uint64_t> head;
+    std::atomic<std::uint32_t> consumerPid;
+    std::atomic<std::uint32_t> notEmptySeq;
+    std::atomic<std::uint32_t> notEmptySleepers;
+  };
+
+  static_assert (std::is_standard_layout<Header>::value,
+                 "The shared memory header must be standard layout");
+  static_assert (ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+                 "Atomics shared between processes must be lock free");
+  static_assert (sizeof (std::atomic<std::uint32_t>) == sizeof (std::uint32_t),
+                 "The futex words must be plain 32 bit words");
+
+  // "cdnshmq1"
+  static constexpr std::uint64_t Magic = 0x31716d68736e6463;
+
+  // Offset of the first slot from the start of the shared memory object
+  static constexpr std::size_t SlotsOffset = (sizeof (Header) + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+
+  // Checks of the other side's cursor before a waiting side sleeps
+  static constexpr int SpinRounds = 128;
+
+  // How long to wait for another process to finish formatting the object
+  // before deciding it died doing so
+  static constexpr std::chrono::milliseconds::rep AttachTimeoutMs = 1000;
+
+  // Create and format the object, false if it already exists
+  bool
+  create ()
+    throw (CircularQueueError);
+
+  // Map an existing object and check its layout, false if it went away or
+  // its creator died before formatting it
+  bool
+  attach ()
+    throw (CircularQueueError);
+
+  // Record this process as the holder of m_role
+  void
+  claimRole ()
+    throw (CircularQueueError);
+
+  void
+  map (std::size_t bytes)
+    throw (CircularQueueError);
+
+  void
+  unmap ()
+    noexcept;
+
+  T*
+  slot (std::uint64_t count)
+    noexcept;
+
+  T
+  take (std::uint64_t head)
+    noexcept;
+
+  // Wait on seq until ready returns true, deadline passes or the peer dies,
+  // spinning first. The side being waited for bumps seq and wakes us when it
+  // sees a sleeper, a dead one never will so sleeps last at most PeerCheckMs.
+  template <typename Predicate>
+  bool
+  waitFor (std::atomic<std::uint32_t>& seq,
+           std::atomic<std::uint32_t>& sleepers,
+           Predicate ready,
+           std::chrono::steady_clock::time_point deadline)
+    noexcept;
+
+  static void
+  wake (std::atomic<std::uint32_t>& seq,
+        std::atomic<std::uint32_t>& sleepers,
+        bool all)
+    noexcept;
+
+  // timeoutNs < 0 waits forever
+  static void
+  futexWait (std::atomic<std::uint32_t>& seq,
+             std::uint32_t observed,
+             std::int64_t timeoutNs)
+    noexcept;
+
+  static void
+  futexWake (std::atomic<std::uint32_t>& seq, int count)
+    noexcept;
+
+  static bool
+  isAlive (std::uint32_t pid)
+    noexcept;
+
+  // The process holding the other role died without detaching
+  bool
+  isPeerDead ()
+    const
+    noexcept;
+
+  const std::string       m_name;
+  const ShmQueueRole      m_role;
+  const CircularQueueMode m_mode;
+  int                     m_fd;
+  void*                   m_region;
+  std::size_t             m_regionBytes;
+  Header*                 m_header;
+  std::size_t             m_capacity;
+  bool                    m_peerCrashed;
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "ShmCircularQueue.icc"
+
+#endif // #ifndef CDN_SHM_CIRCULAR_QUEUE_INCLUDED
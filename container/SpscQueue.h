@@ -0,0 +1,196 @@
+// SpscQueue.h
+//
+#ifndef CDN_SPSC_QUEUE_INCLUDED
+#define CDN_SPSC_QUEUE_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <type_traits>
+
+#include "CircularQueueTypes.h"
+
+// TODO: dependency on boost
+#include "boost/optional.hpp"
+
+// TODO: dependency on EventCount
+#include "EventCount.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief The SpscQueue class is a lock-free single-producer/single-consumer
+//! variant of CircularQueue
+//!
+//! SpscQueue has the same FIFO ordering and the same push/emplace/pop surface
+//! as CircularQueue, but exactly one thread may push/emplace and exactly one 
+//! (possibly different) thread may pop. In exchange push and pop never take a
+//! lock, the head and tail cursors are published with acquire/release atomics
+//! and a thread is only parked when it actually has to wait.
+//!
+//! The CircularQueueMode semantics are kept where they make sense:
+//!  - FailOnWrite raises CircularQueueError when the queue is full
+//!  - BlockOnWrite makes the producer wait for room
+//!  - NonBlockingWrite is not supported, overwriting the oldest element would
+//!    require the producer to move the consumer's cursor which can not be done
+//!    without a lock. The constructor raises CircularQueueError in this mode.
+//!
+//! The observers (isEmpty, size, isShutdown) and shutdown may be called from 
+//! any thread.
+//!
+//! At a minimum T must meet the requirements of 
+//! <a href="http://en.cppreference.com/w/cpp/concept/MoveConstructible">MoveConstructible</a> and 
+//! <a href="http://en.cppreference.com/w/cpp/concept/Destructible">Destructible</a>.
+//! Elements are only constructed when pushed and destroyed when popped, so T
+//! does not need to be DefaultConstructible.
+//!
+template <typename T, std::size_t N>
+class SpscQueue
+{
+  static_assert (N > 0, "SpscQueue requires a capacity of at least one element");
+
+public:
+
+  //! No elements are constructed until they are pushed
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the mode is
+  //! NonBlockingWrite
+  explicit
+  SpscQueue (const CircularQueueMode&)
+    throw (CircularQueueError);
+
+  //! Destroy any elements that were never popped
+  ~SpscQueue ();
+
+  //! = delete
+  SpscQueue (const SpscQueue&) = delete;
+  //! = delete
+  SpscQueue& operator= (const SpscQueue&) = delete;
+
+  //! = delete
+  SpscQueue (SpscQueue&&) = delete;
+  //! = delete
+  SpscQueue& operator= (SpscQueue&&) = delete;
+
+  //! Return true if there are no elements available to be popped
+  bool
+  isEmpty ()
+    const
+    noexcept;
+
+  //! Number of elements available to be popped from the queue
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! The maximum number of element the Queue can hold
+  std::size_t
+  max ()
+    const
+    noexcept;
+
+  //! Tell the queue to shutdown, this will force any blocking push or pop to
+  //! return
+  void
+  shutdown ()
+    noexcept;
+
+  //! Return true if the queue has been shutdown
+  bool
+  isShutdown ()
+    const
+    noexcept;
+
+  //! Construct the element in place at the tail of the queue, potentially 
+  //! waiting for space based upon the mode. Producer thread only.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full 
+  //! in FailOnWrite mode, on mutex error or if the T constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  template <typename... Args>
+  void
+  emplace (Args&&... args)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Copy the element onto the queue, potentially waiting for space based upon
+  //! the mode. Producer thread only.
+  //!
+  //! T must support
+  //! <a href="http://en.cppreference.com/w/cpp/concept/CopyConstructible">CopyConstructible</a>
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError if the queue is full 
+  //! in FailOnWrite mode, on mutex error or if the T copy constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue
+  //! was shutdown while waiting for space
+  void
+  push (const T&)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the front of the queue out and return it, waiting forever if the 
+  //! queue contains no elements. Consumer thread only.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  T
+  pop ()
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  //! Move the front of the queue out and return it, if there are no available
+  //! elements before the timeout expires an 'empty' optional<T> will be
+  //! returned. Consumer thread only.
+  //!
+  //! \throw CircularQueueError Raise CircularQueueError on mutex error or if
+  //! the T move constructor throws
+  //! \throw CircularQueueShutdown Raise CircularQueueShutdown if the queue is
+  //! empty and has been shutdown
+  template <typename Rep, typename Period>
+  boost::optional<T>
+  pop (const std::chrono::duration<Rep, Period>& rel_time)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+private:
+
+  typedef typename std::aligned_storage<sizeof (T), alignof (T)>::type Slot;
+
+  T*
+  slot (std::size_t)
+    noexcept;
+
+  void
+  waitForSpace (std::size_t)
+    throw (CircularQueueError, CircularQueueShutdown);
+
+  T
+  take (std::size_t)
+    throw (CircularQueueError);
+
+  void
+  release (std::size_t)
+    noexcept;
+
+  const CircularQueueMode  m_mode;
+  std::atomic<bool>        m_isShutdown;
+  // head and tail are free running counts of pops and pushes, the slot index
+  // is the count modulo N and the difference is the number of elements
+  std::atomic<std::size_t> m_head;
+  std::atomic<std::size_t> m_tail;
+  thread::EventCount       m_notEmpty;
+  thread::EventCount       m_notFull;
+  Slot                     m_slots[N];
+};
+
+} // namespace container
+} // namespace cdn
+
+#include "SpscQueue.icc"
+
+#endif // #ifndef CDN_SPSC_QUEUE_INCLUDED
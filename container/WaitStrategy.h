@@ -0,0 +1,222 @@
+// WaitStrategy.h
+//
+#ifndef CDN_WAIT_STRATEGY_INCLUDED
+#define CDN_WAIT_STRATEGY_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Container related classes and utilities
+namespace container
+{
+
+//! \brief CircularQueue wait policy that parks on a condition variable
+//! straight away, the default
+struct BlockingWait { };
+
+//! \brief CircularQueue wait policy that spins with a pause instruction and
+//! never sleeps, for threads pinned to their own core
+struct BusySpinWait { };
+
+//! \brief CircularQueue wait policy that spins for a while and then yields
+//! the core between checks, it never sleeps
+struct SpinYieldWait { };
+
+//! \brief CircularQueue wait policy that spins for an adaptive number of
+//! rounds and then parks on the condition variable. The spin budget doubles
+//! each time spinning pays off and halves each time it has to park.
+struct SpinParkWait { };
+
+//! Tell the CPU we are in a spin loop, a pause on x86 and a yield hint on
+//! ARM, nothing elsewhere
+inline
+void
+cpuRelax ()
+  noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause ();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__ ("yield");
+#endif
+}
+
+//! \brief How a wait policy spins before CircularQueue parks the thread
+//!
+//! CircularQueue releases its lock and calls spin once per round, with ready
+//! telling whether the other side has made progress, and retakes the lock
+//! to check after every round. spin returns false once the policy wants the
+//! thread parked instead. succeeded and failed report how the wait ended so
+//! an adaptive policy can tune itself.
+template <typename Strategy>
+class Spinner;
+
+//! \brief BlockingWait never spins
+template <>
+class Spinner<BlockingWait>
+{
+public:
+  //! false, CircularQueue skips spinning entirely
+  static constexpr bool Spins = false;
+
+  template <typename Ready>
+  bool
+  spin (Ready, std::size_t /* round */)
+    noexcept
+  { return false; }
+
+  void
+  succeeded ()
+    noexcept
+  { }
+
+  void
+  failed ()
+    noexcept
+  { }
+};
+
+//! \brief BusySpinWait spins forever
+template <>
+class Spinner<BusySpinWait>
+{
+public:
+  //! Pauses per round
+  static constexpr std::size_t RoundSpins = 64;
+  static constexpr bool        Spins      = true;
+
+  template <typename Ready>
+  bool
+  spin (Ready ready, std::size_t /* round */)
+    noexcept
+  {
+    for (std::size_t i=0; i < RoundSpins && ! ready (); ++i)
+    {
+      cpuRelax ();
+    }
+    return true;
+  }
+
+  void
+  succeeded ()
+    noexcept
+  { }
+
+  void
+  failed ()
+    noexcept
+  { }
+};
+
+//! \brief SpinYieldWait spins for SpinRounds rounds, after that every round
+//! is a single check and a yield
+template <>
+class Spinner<SpinYieldWait>
+{
+public:
+  //! Pauses per round
+  static constexpr std::size_t RoundSpins = 64;
+  //! Rounds spent spinning before yielding
+  static constexpr std::size_t SpinRounds = 16;
+  static constexpr bool        Spins      = true;
+
+  template <typename Ready>
+  bool
+  spin (Ready ready, std::size_t round)
+    noexcept
+  {
+    if (round >= SpinRounds)
+    {
+      if (! ready ())
+      {
+        std::this_thread::yield ();
+      }
+      return true;
+    }
+
+    for (std::size_t i=0; i < RoundSpins && ! ready (); ++i)
+    {
+      cpuRelax ();
+    }
+    return true;
+  }
+
+  void
+  succeeded ()
+    noexcept
+  { }
+
+  void
+  failed ()
+    noexcept
+  { }
+};
+
+//! \brief SpinParkWait spins for up to its current budget of rounds
+//!
+//! The budget is shared by the threads waiting on the same side of a queue,
+//! it is only a hint so it is a relaxed atomic.
+template <>
+class Spinner<SpinParkWait>
+{
+public:
+  //! Pauses per round
+  static constexpr std::size_t RoundSpins = 64;
+  //! Smallest and largest budget, in rounds
+  static constexpr std::uint32_t MinRounds = 1;
+  static constexpr std::uint32_t MaxRounds = 256;
+  static constexpr bool          Spins     = true;
+
+  Spinner ()
+    noexcept
+    : m_budget (16)
+  { }
+
+  template <typename Ready>
+  bool
+  spin (Ready ready, std::size_t round)
+    noexcept
+  {
+    if (round >= m_budget.load (std::memory_order_relaxed))
+    {
+      return false;
+    }
+
+    for (std::size_t i=0; i < RoundSpins && ! ready (); ++i)
+    {
+      cpuRelax ();
+    }
+    return true;
+  }
+
+  //! Spinning paid off, allow more next time
+  void
+  succeeded ()
+    noexcept
+  {
+    auto budget = m_budget.load (std::memory_order_relaxed);
+    m_budget.store (budget * 2 < MaxRounds ? budget * 2 : MaxRounds, std::memory_order_relaxed);
+  }
+
+  //! The thread had to park anyway, spin less next time
+  void
+  failed ()
+    noexcept
+  {
+    auto budget = m_budget.load (std::memory_order_relaxed);
+    m_budget.store (budget / 2 > MinRounds ? budget / 2 : MinRounds, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<std::uint32_t> m_budget;
+};
+
+} // namespace container
+} // namespace cdn
+
+#endif // #ifndef CDN_WAIT_STRATEGY_INCLUDED
@@ -0,0 +1,442 @@
+// test_BroadcastQueue.cc
+
+#include "BroadcastQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+using cdn::container::BroadcastQueue;
+using cdn::container::CircularQueueError;
+using cdn::container::CircularQueueMode;
+using cdn::container::CircularQueueShutdown;
+
+// Throws from its copy constructor when asked to
+struct Fragile
+{
+  explicit
+  Fragile (int v)
+    : value (v)
+  { }
+
+  Fragile (const Fragile& other)
+    : value (other.value)
+  {
+    if (value < 0)
+    {
+      throw std::runtime_error ("copy");
+    }
+  }
+
+  int value;
+};
+
+} // namespace
+
+
+TEST(BroadcastQueue,EverySubscriber)
+{
+  BroadcastQueue<int, 8> q (CircularQueueMode::FailOnWrite);
+  auto a = q.subscribe ();
+  auto b = q.subscribe ();
+  EXPECT_EQ (0u, a);
+  EXPECT_EQ (1u, b);
+  EXPECT_EQ (2u, q.subscribers ());
+  EXPECT_EQ (8u, q.max ());
+
+  for (int i=0; i < 5; ++i)
+  {
+    q.push (i);
+  }
+  EXPECT_EQ (5u, q.size (a));
+  EXPECT_EQ (5u, q.size (b));
+
+  std::vector<int> seenA;
+  std::vector<int> seenB;
+  EXPECT_EQ (5u, q.consume (a, [&] (const int& v) { seenA.push_back (v); }));
+  EXPECT_EQ (0u, q.size (a));
+  EXPECT_EQ (5u, q.size (b));
+  EXPECT_EQ (5u, q.tryConsume (b, [&] (const int& v) { seenB.push_back (v); }));
+
+  std::vector<int> expected { 0, 1, 2, 3, 4 };
+  EXPECT_EQ (expected, seenA);
+  EXPECT_EQ (expected, seenB);
+
+  EXPECT_EQ (0u, q.tryConsume (a, [] (const int&) { }));
+  EXPECT_THROW (q.size (5), CircularQueueError);
+  EXPECT_THROW (q.tryConsume (5, [] (const int&) { }), CircularQueueError);
+}
+
+TEST(BroadcastQueue,InPlace)
+{
+  BroadcastQueue<std::string, 4> q (CircularQueueMode::FailOnWrite);
+  auto a = q.subscribe ();
+  auto b = q.subscribe ();
+
+  q.emplace (100, 'x');
+
+  const std::string* seenA = nullptr;
+  const std::string* seenB = nullptr;
+  q.consume (a, [&] (const std::string& s) { seenA = &s; });
+  q.consume (b, [&] (const std::string& s) { seenB = &s; });
+
+  ASSERT_NE (nullptr, seenA);
+  EXPECT_EQ (seenA, seenB);
+  EXPECT_EQ (std::string (100, 'x'), *seenA);
+}
+
+TEST(BroadcastQueue,HeapAligned)
+{
+  // the cursors are cache line aligned, new has to honour that
+  std::unique_ptr<BroadcastQueue<int, 8>> q (new BroadcastQueue<int, 8> (CircularQueueMode::FailOnWrite));
+  EXPECT_EQ (0u, reinterpret_cast<std::uintptr_t> (q.get ()) % cdn::container::CacheLineSize);
+}
+
+TEST(BroadcastQueue,FailOnWrite)
+{
+  BroadcastQueue<int, 4> q (CircularQueueMode::FailOnWrite);
+  auto fast = q.subscribe ();
+  auto slow = q.subscribe ();
+
+  for (int i=0; i < 4; ++i)
+  {
+    q.push (i);
+  }
+  q.consume (fast, [] (const int&) { });
+
+  // The slowest subscriber holds the ring
+  EXPECT_THROW (q.push (4), CircularQueueError);
+
+  int first = -1;
+  q.consume (slow, [&] (const int& v) { if (first < 0) first = v; });
+  EXPECT_EQ (0, first);
+  q.push (4);
+  EXPECT_EQ (1u, q.size (slow));
+}
+
+TEST(BroadcastQueue,BlockOnWrite)
+{
+  BroadcastQueue<int, 16> q (CircularQueueMode::BlockOnWrite);
+  const int count = 100000;
+  const int readers = 3;
+
+  std::vector<std::size_t> subscribers;
+  for (int r=0; r < readers; ++r)
+  {
+    subscribers.push_back (q.subscribe ());
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<int> failures (0);
+  for (auto subscriber : subscribers)
+  {
+    threads.emplace_back ([&, subscriber]
+                          {
+                            int next = 0;
+                            while (next < count)
+                            {
+                              q.consume (subscriber,
+                                         [&] (const int& v)
+                                         {
+                                           if (v != next)
+                                           {
+                                             ++failures;
+                                           }
+                                           ++next;
+                                         });
+                            }
+                          });
+  }
+
+  for (int i=0; i < count; ++i)
+  {
+    q.push (i);
+  }
+  for (auto& t : threads)
+  {
+    t.join ();
+  }
+  EXPECT_EQ (0, failures.load ());
+}
+
+TEST(BroadcastQueue,MultipleProducers)
+{
+  BroadcastQueue<int, 8> q (CircularQueueMode::BlockOnWrite);
+  const int producers = 4;
+  const int count = 20000;
+  auto a = q.subscribe ();
+  auto b = q.subscribe ();
+
+  std::vector<std::thread> threads;
+  for (int p=0; p < producers; ++p)
+  {
+    threads.emplace_back ([&, p]
+                          {
+                            for (int i=0; i < count; ++i)
+                            {
+                              q.push (p * count + i);
+                            }
+                          });
+  }
+
+  // Every producer's elements stay in order, each subscriber sees them all
+  auto reader = [&] (std::size_t subscriber, long long& sum)
+                {
+                  std::vector<int> last (producers, -1);
+                  int seen = 0;
+                  while (seen < producers * count)
+                  {
+                    seen += q.consume (subscriber,
+                                       [&] (const int& v)
+                                       {
+                                         EXPECT_LT (last[v / count], v % count);
+                                         last[v / count] = v % count;
+                                         sum += v;
+                                       });
+                  }
+                };
+
+  long long sumB = 0;
+  std::thread other ([&] { reader (b, sumB); });
+  long long sumA = 0;
+  reader (a, sumA);
+  other.join ();
+  for (auto& t : threads)
+  {
+    t.join ();
+  }
+
+  long long n = producers * count;
+  EXPECT_EQ (n * (n - 1) / 2, sumA);
+  EXPECT_EQ (sumA, sumB);
+}
+
+TEST(BroadcastQueue,NonBlockingWrite)
+{
+  BroadcastQueue<int, 4> q (CircularQueueMode::NonBlockingWrite);
+  auto a = q.subscribe ();
+
+  for (int i=0; i < 10; ++i)
+  {
+    q.push (i);
+  }
+  EXPECT_EQ (4u, q.size (a));
+
+  std::vector<int> seen;
+  EXPECT_EQ (4u, q.consume (a, [&] (const int& v) { seen.push_back (v); }));
+  EXPECT_EQ ((std::vector<int> { 6, 7, 8, 9 }), seen);
+  EXPECT_EQ (6u, q.missed (a));
+
+  EXPECT_THROW ((BroadcastQueue<std::string, 4> (CircularQueueMode::NonBlockingWrite)),
+                CircularQueueError);
+}
+
+TEST(BroadcastQueue,NonBlockingWriteRace)
+{
+  struct Pair { std::uint64_t a; std::uint64_t b; };
+
+  BroadcastQueue<Pair, 8> q (CircularQueueMode::NonBlockingWrite);
+  auto subscriber = q.subscribe ();
+  const std::uint64_t count = 200000;
+
+  std::thread producer ([&]
+                        {
+                          for (std::uint64_t i=1; i <= count; ++i)
+                          {
+                            q.push (Pair { i, i * 3 });
+                          }
+                          q.shutdown ();
+                        });
+
+  // The producer never waits, a torn element must never be handed out
+  std::uint64_t last = 0;
+  std::uint64_t seen = 0;
+  bool torn = false;
+  try
+  {
+    for (;;)
+    {
+      seen += q.consume (subscriber,
+                         [&] (const Pair& p)
+                         {
+                           torn |= (p.b != p.a * 3) || p.a <= last;
+                           last = p.a;
+                         });
+    }
+  }
+  catch (const CircularQueueShutdown&)
+  {
+  }
+  producer.join ();
+
+  EXPECT_FALSE (torn);
+  EXPECT_EQ (count, last);
+  EXPECT_EQ (count, seen + q.missed (subscriber));
+}
+
+TEST(BroadcastQueue,Stages)
+{
+  BroadcastQueue<int, 4> q (CircularQueueMode::FailOnWrite);
+  auto journal = q.subscribe ();
+  auto replicate = q.subscribe ();
+  auto apply = q.subscribe ({ journal, replicate });
+
+  q.push (1);
+  q.push (2);
+
+  // Nothing for apply until both stages before it consumed
+  EXPECT_EQ (0u, q.tryConsume (apply, [] (const int&) { }));
+  q.consume (journal, [] (const int&) { });
+  EXPECT_EQ (0u, q.tryConsume (apply, [] (const int&) { }));
+  EXPECT_EQ (0u, q.consume (apply, [] (const int&) { }, std::chrono::milliseconds (1)));
+  q.consume (replicate, [] (const int&) { });
+  EXPECT_EQ (2u, q.tryConsume (apply, [] (const int&) { }));
+
+  EXPECT_THROW (q.unsubscribe (journal), CircularQueueError);
+  q.unsubscribe (apply);
+  q.unsubscribe (journal);
+  EXPECT_THROW (q.subscribe ({ journal }), CircularQueueError);
+}
+
+TEST(BroadcastQueue,StagesThreaded)
+{
+  BroadcastQueue<int, 8> q (CircularQueueMode::BlockOnWrite);
+  auto first = q.subscribe ();
+  auto second = q.subscribe ({ first });
+  const int count = 50000;
+
+  // The first stage marks every element it consumed
+  std::vector<char> marked (count, 0);
+  std::atomic<int> failures (0);
+
+  std::thread stage1 ([&]
+                      {
+                        int seen = 0;
+                        while (seen < count)
+                        {
+                          seen += q.consume (first, [&] (const int& v) { marked[v] = 1; });
+                        }
+                      });
+  std::thread stage2 ([&]
+                      {
+                        int seen = 0;
+                        while (seen < count)
+                        {
+                          seen += q.consume (second,
+                                             [&] (const int& v)
+                                             {
+                                               if (! marked[v])
+                                               {
+                                                 ++failures;
+                                               }
+                                             });
+                        }
+                      });
+
+  for (int i=0; i < count; ++i)
+  {
+    q.push (i);
+  }
+  stage1.join ();
+  stage2.join ();
+  EXPECT_EQ (0, failures.load ());
+}
+
+TEST(BroadcastQueue,Unsubscribe)
+{
+  BroadcastQueue<int, 2> q (CircularQueueMode::BlockOnWrite);
+  auto a = q.subscribe ();
+  auto idle = q.subscribe ();
+
+  q.push (1);
+  q.push (2);
+
+  std::thread producer ([&] { q.push (3); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+
+  // Dropping the idle subscriber is not enough, a still holds the ring
+  q.unsubscribe (idle);
+  EXPECT_EQ (1u, q.subscribers ());
+  q.consume (a, [] (const int&) { });
+  producer.join ();
+
+  int last = 0;
+  EXPECT_EQ (1u, q.consume (a, [&] (const int& v) { last = v; }));
+  EXPECT_EQ (3, last);
+
+  // The free number is handed out again
+  EXPECT_EQ (idle, q.subscribe ());
+  EXPECT_THROW (q.unsubscribe (5), CircularQueueError);
+}
+
+TEST(BroadcastQueue,NoSubscribers)
+{
+  BroadcastQueue<int, 2> q (CircularQueueMode::FailOnWrite);
+  for (int i=0; i < 10; ++i)
+  {
+    q.push (i);
+  }
+
+  // A late subscriber only sees what is pushed after it
+  auto a = q.subscribe ();
+  EXPECT_EQ (0u, q.size (a));
+  q.push (10);
+  int last = 0;
+  EXPECT_EQ (1u, q.consume (a, [&] (const int& v) { last = v; }));
+  EXPECT_EQ (10, last);
+}
+
+TEST(BroadcastQueue,Errors)
+{
+  BroadcastQueue<Fragile, 4> q (CircularQueueMode::FailOnWrite);
+  auto a = q.subscribe ();
+
+  q.push (Fragile (1));
+  EXPECT_THROW (q.push (Fragile (-1)), CircularQueueError);
+  q.push (Fragile (2));
+
+  // The slot the failed copy claimed is skipped
+  std::vector<int> seen;
+  EXPECT_EQ (2u, q.consume (a, [&] (const Fragile& f) { seen.push_back (f.value); }));
+  EXPECT_EQ ((std::vector<int> { 1, 2 }), seen);
+
+  // A throwing handler consumes the element it threw on
+  q.push (Fragile (3));
+  q.push (Fragile (4));
+  EXPECT_THROW (q.consume (a, [] (const Fragile&) { throw std::runtime_error ("handler"); }),
+                CircularQueueError);
+  EXPECT_EQ (1u, q.size (a));
+
+  for (std::size_t i=1; i < BroadcastQueue<int, 4>::MaxSubscribers; ++i)
+  {
+    q.subscribe ();
+  }
+  EXPECT_THROW (q.subscribe (), CircularQueueError);
+}
+
+TEST(BroadcastQueue,Shutdown)
+{
+  BroadcastQueue<int, 2> q (CircularQueueMode::BlockOnWrite);
+  auto a = q.subscribe ();
+
+  std::thread consumer ([&]
+                        {
+                          EXPECT_THROW (q.consume (a, [] (const int&) { }), CircularQueueShutdown);
+                        });
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+  q.shutdown ();
+  consumer.join ();
+
+  EXPECT_TRUE (q.isShutdown ());
+  EXPECT_THROW (q.tryConsume (a, [] (const int&) { }), CircularQueueShutdown);
+}
@@ -4,9 +4,22 @@
 
 #include "CircularQueue.h"
 
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/epoll.h>
 
 #include "gtest/gtest.h"
 
@@ -16,7 +29,7 @@ namespace
 class NoMove
 {
 public:
-  NoMove () // default constructor required
+  NoMove ()
     : m_idx (-1)
   { }
 
@@ -49,6 +62,63 @@ operator<< (std::ostream& strm, const NoMove& ndc)
   return strm << "NoMove.idx=" << ndc.idx ();
 }
 
+class MoveOnly
+{
+public:
+  MoveOnly ()
+    : m_payload ()
+  { }
+
+  explicit MoveOnly (std::size_t len)
+    : m_payload (len, 'x')
+  { }
+
+  ~MoveOnly () = default;
+
+  // disallow copy
+  MoveOnly (const MoveOnly&) = delete;
+  MoveOnly& operator= (const MoveOnly&) = delete;
+
+  // allow move
+  MoveOnly (MoveOnly&&) = default;
+  MoveOnly& operator= (MoveOnly&&) = default;
+
+  const std::vector<char>&
+  payload ()
+    const
+  { return m_payload; }
+
+private:
+  std::vector<char> m_payload;
+};
+
+// No default constructor and a constructor that can be told to throw
+class NoDefault
+{
+public:
+  explicit NoDefault (int val, bool fail = false)
+    : m_val (val)
+  { 
+    if (fail)
+    {
+      throw std::runtime_error ("NoDefault construction failed");
+    }
+  }
+
+  ~NoDefault () = default;
+
+  NoDefault (const NoDefault&) = default;
+  NoDefault& operator= (const NoDefault&) = default;
+
+  int
+  val ()
+    const
+  { return m_val; }
+
+private:
+  int m_val;
+};
+
 } // namespace
 
 
@@ -82,6 +152,17 @@ TEST(Int,InitValNonBlockingModeConstructor)
   cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::NonBlockingWrite, 18);
 }
 
+TEST(Int,HeapAligned)
+{
+  // new has to honour the cache line alignment of the bookkeeping
+  std::vector<std::unique_ptr<cdn::container::CircularQueue<int, 5>>> queues;
+  for (int i=0; i < 16; ++i)
+  {
+    queues.emplace_back (new cdn::container::CircularQueue<int, 5> (cdn::container::CircularQueueMode::BlockOnWrite));
+    EXPECT_EQ (reinterpret_cast<std::uintptr_t> (queues.back ().get ()) % cdn::container::CacheLineSize, 0UL);
+  }
+}
+
 TEST(Int,Empty)
 {
   cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
@@ -299,7 +380,7 @@ TEST(Int,PopTimeout)
 {
   cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
   
-  boost::optional<const int> v = cq.pop (std::chrono::milliseconds (1800));
+  boost::optional<int> v = cq.pop (std::chrono::milliseconds (1800));
   
   EXPECT_TRUE (! v);
 }
@@ -317,7 +398,7 @@ TEST(Int,BlockedRead)
                    cq.push (1118);
                  });
   
-  boost::optional<const int> v = cq.pop (std::chrono::seconds (3));
+  boost::optional<int> v = cq.pop (std::chrono::seconds (3));
   
   EXPECT_FALSE (! v);
 
@@ -364,3 +445,1395 @@ TEST(NoMove,PushPop)
   
   cq.dump (std::cout);
 }
+
+TEST(Int,PushRange)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::vector<int> in { 1, 2, 3 };
+  EXPECT_EQ (cq.pushRange (in.begin (), in.end ()), in.end ());
+  EXPECT_EQ (cq.size (), 3UL);
+
+  cq.dump (std::cout);
+
+  EXPECT_EQ (cq.pop (), 1);
+  EXPECT_EQ (cq.pop (), 2);
+  EXPECT_EQ (cq.pop (), 3);
+}
+
+TEST(Int,PushRangeWraparound)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.push (10);
+  cq.push (11);
+  cq.push (12);
+  cq.pop ();
+  cq.pop ();
+
+  // write index is at 3, the range wraps around the end of the array
+  std::vector<int> in { 13, 14, 15, 16 };
+  EXPECT_EQ (cq.pushRange (in.begin (), in.end ()), in.end ());
+  
+  cq.dump (std::cout);
+
+  std::vector<int> out;
+  EXPECT_EQ (cq.popAll (std::back_inserter (out)), 5UL);
+  EXPECT_EQ (out, (std::vector<int> { 12, 13, 14, 15, 16 }));
+}
+
+TEST(Int,PushRangeFailOnFull)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::vector<int> in { 1, 2, 3, 4, 5, 6, 7 };
+  auto rest = cq.pushRange (in.begin (), in.end ());
+  EXPECT_EQ (rest - in.begin (), 5);
+  EXPECT_EQ (cq.size (), 5UL);
+}
+
+TEST(Int,PushRangeNonBlocking)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  std::vector<int> in { 1, 2, 3, 4, 5, 6, 7 };
+  EXPECT_EQ (cq.pushRange (in.begin (), in.end ()), in.end ());
+  EXPECT_EQ (cq.size (), 5UL);
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, (std::vector<int> { 3, 4, 5, 6, 7 }));
+}
+
+TEST(Int,PushRangeBlockOnWrite)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::vector<int> in (23);
+  for (int i=0; i < 23; ++i)
+  {
+    in[i] = i;
+  }
+
+  std::vector<int> out;
+  std::thread t ([&] 
+                 {
+                   while (out.size () < in.size ())
+                   {
+                     cq.popBulk (std::back_inserter (out), 4);
+                   }
+                 });
+
+  EXPECT_EQ (cq.pushRange (in.begin (), in.end ()), in.end ());
+  t.join ();
+
+  EXPECT_EQ (out, in);
+}
+
+TEST(Int,PopBulk)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+  for (int i=0; i < 5; ++i)
+  {
+    cq.push (i);
+  }
+
+  int out[3] = { };
+  EXPECT_EQ (cq.popBulk (out, 3), 3UL);
+  EXPECT_EQ (out[0], 0);
+  EXPECT_EQ (out[2], 2);
+  EXPECT_EQ (cq.size (), 2UL);
+
+  EXPECT_EQ (cq.popBulk (out, 3), 2UL);
+  EXPECT_EQ (out[0], 3);
+  EXPECT_EQ (out[1], 4);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Int,PopBulkTimeout)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  int out[3] = { };
+  EXPECT_EQ (cq.popBulk (out, 3, std::chrono::milliseconds (150)), 0UL);
+}
+
+TEST(Int,PopAllEmpty)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::vector<int> out;
+  EXPECT_EQ (cq.popAll (std::back_inserter (out)), 0UL);
+
+  cq.shutdown ();
+  EXPECT_THROW (cq.popAll (std::back_inserter (out)), cdn::container::CircularQueueShutdown);
+}
+
+TEST(Int,TryPop)
+{
+  cdn::container::CircularQueue<int, 5> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  int v = -1;
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Empty);
+  EXPECT_EQ (v, -1);
+
+  cq.push (31);
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (v, 31);
+
+  cq.shutdown ();
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Shutdown);
+}
+
+TEST(Int,TryPush)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  int one = 1;
+  EXPECT_EQ (cq.tryPush (one), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (cq.tryEmplace (2), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (cq.tryPush (3), cdn::container::CircularQueueStatus::Full);
+  EXPECT_EQ (cq.tryEmplace (3), cdn::container::CircularQueueStatus::Full);
+  EXPECT_EQ (cq.size (), 2UL);
+
+  cq.shutdown ();
+  EXPECT_EQ (cq.tryPush (3), cdn::container::CircularQueueStatus::Shutdown);
+
+  // Elements pushed before the shutdown can still be popped
+  int v = 0;
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (v, 1);
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (v, 2);
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Shutdown);
+}
+
+TEST(Int,TryPushBlockAndNonBlocking)
+{
+  // A BlockOnWrite queue does not wait in tryPush
+  cdn::container::CircularQueue<int, 1> block (cdn::container::CircularQueueMode::BlockOnWrite);
+  EXPECT_EQ (block.tryPush (1), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (block.tryPush (2), cdn::container::CircularQueueStatus::Full);
+
+  // A NonBlockingWrite queue is never full
+  cdn::container::CircularQueue<int, 2> overwrite (cdn::container::CircularQueueMode::NonBlockingWrite);
+  for (int i=0; i < 5; ++i)
+  {
+    EXPECT_EQ (overwrite.tryPush (i), cdn::container::CircularQueueStatus::Ok);
+  }
+  EXPECT_EQ (overwrite.pop (), 3);
+  EXPECT_EQ (overwrite.pop (), 4);
+  EXPECT_EQ (overwrite.stats ().overwritten, 3UL);
+}
+
+TEST(Int,TryPushTimeout)
+{
+  cdn::container::CircularQueue<int, 1> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (1);
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_EQ (cq.tryPush (2, std::chrono::milliseconds (20)), cdn::container::CircularQueueStatus::Timeout);
+  EXPECT_GE (std::chrono::steady_clock::now () - start, std::chrono::milliseconds (20));
+  EXPECT_EQ (cq.stats ().fullWaits, 1UL);
+
+  // Room made while waiting
+  std::thread consumer ([&]
+                        {
+                          std::this_thread::sleep_for (std::chrono::milliseconds (20));
+                          cq.pop ();
+                        });
+  int two = 2;
+  EXPECT_EQ (cq.tryPush (two, std::chrono::seconds (10)), cdn::container::CircularQueueStatus::Ok);
+  consumer.join ();
+  EXPECT_EQ (cq.pop (), 2);
+
+  // Shutdown while waiting
+  cq.push (3);
+  std::thread stopper ([&]
+                       {
+                         std::this_thread::sleep_for (std::chrono::milliseconds (20));
+                         cq.shutdown ();
+                       });
+  EXPECT_EQ (cq.tryPush (4, std::chrono::seconds (10)), cdn::container::CircularQueueStatus::Shutdown);
+  stopper.join ();
+}
+
+TEST(Int,TryPushTimeoutNonBlocking)
+{
+  // A NonBlockingWrite queue overwrites rather than waiting, as push does
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+  cq.push (1);
+  cq.push (2);
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_EQ (cq.tryPush (3, std::chrono::seconds (10)), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_LT (std::chrono::steady_clock::now () - start, std::chrono::seconds (5));
+  EXPECT_EQ (cq.stats ().fullWaits, 0UL);
+  EXPECT_EQ (cq.stats ().overwritten, 1UL);
+  EXPECT_EQ (cq.pop (), 2);
+  EXPECT_EQ (cq.pop (), 3);
+}
+
+TEST(UniquePtr,TryPush)
+{
+  cdn::container::CircularQueue<std::unique_ptr<int>, 1> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::unique_ptr<int> first (new int (1));
+  EXPECT_EQ (cq.tryPush (std::move (first)), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_FALSE (first);
+
+  // Not moved from when it was not pushed
+  std::unique_ptr<int> second (new int (2));
+  EXPECT_EQ (cq.tryPush (std::move (second)), cdn::container::CircularQueueStatus::Full);
+  ASSERT_TRUE (second != nullptr);
+  EXPECT_EQ (cq.tryPush (std::move (second), std::chrono::milliseconds (1)), cdn::container::CircularQueueStatus::Timeout);
+  ASSERT_TRUE (second != nullptr);
+  EXPECT_EQ (*second, 2);
+
+  std::unique_ptr<int> out;
+  EXPECT_EQ (cq.tryPop (out), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (*out, 1);
+  EXPECT_EQ (cq.tryEmplace (new int (3)), cdn::container::CircularQueueStatus::Ok);
+}
+
+TEST(UniquePtr,PushPop)
+{
+  cdn::container::CircularQueue<std::unique_ptr<int>, 3> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  cq.push (std::unique_ptr<int> (new int (1)));
+  cq.emplace (new int (2));
+  cq.push (std::unique_ptr<int> (new int (3)));
+  cq.push (std::unique_ptr<int> (new int (4)));
+
+  std::unique_ptr<int> v = cq.pop ();
+  EXPECT_EQ (*v, 2);
+
+  boost::optional<std::unique_ptr<int>> opt = cq.pop (std::chrono::milliseconds (0));
+  ASSERT_FALSE (! opt);
+  EXPECT_EQ (**opt, 3);
+
+  std::unique_ptr<int> out;
+  EXPECT_EQ (cq.tryPop (out), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (*out, 4);
+}
+
+TEST(UniquePtr,Bulk)
+{
+  cdn::container::CircularQueue<std::unique_ptr<int>, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::vector<std::unique_ptr<int>> in;
+  for (int i=0; i < 3; ++i)
+  {
+    in.emplace_back (new int (i));
+  }
+  cq.pushRange (std::make_move_iterator (in.begin ()), std::make_move_iterator (in.end ()));
+  EXPECT_EQ (cq.size (), 3UL);
+
+  std::vector<std::unique_ptr<int>> out;
+  EXPECT_EQ (cq.popAll (std::back_inserter (out)), 3UL);
+  EXPECT_EQ (*out[2], 2);
+}
+
+TEST(MoveOnly,PayloadIsMovedNotCopied)
+{
+  cdn::container::CircularQueue<MoveOnly, 2> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  MoveOnly big (4096);
+  const char* data = big.payload ().data ();
+
+  cq.push (std::move (big));
+  MoveOnly v = cq.pop ();
+
+  // the same heap buffer made it through the queue
+  EXPECT_EQ (v.payload ().data (), data);
+  EXPECT_EQ (v.payload ().size (), 4096UL);
+}
+
+TEST(Int,WakeEveryBlockedConsumer)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  // each consumer gets exactly one element, so every notify_one must land on
+  // a different consumer for all of them to finish
+  std::atomic<int> sum (0);
+  std::vector<std::thread> consumers;
+  for (int i=0; i < 4; ++i)
+  {
+    consumers.emplace_back ([&] { sum += cq.pop (); });
+  }
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (250));
+
+  std::vector<int> in { 1, 2, 3, 4 };
+  cq.pushRange (in.begin (), in.end ());
+
+  for (auto& t : consumers)
+  {
+    t.join ();
+  }
+  EXPECT_EQ (sum.load (), 10);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Int,WakeEveryBlockedProducer)
+{
+  cdn::container::CircularQueue<int, 3> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+  for (int i=0; i < 3; ++i)
+  {
+    cq.push (i);
+  }
+
+  std::vector<std::thread> producers;
+  for (int i=0; i < 3; ++i)
+  {
+    producers.emplace_back ([&, i] { cq.push (10 + i); });
+  }
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (250));
+
+  int out[3] = { };
+  EXPECT_EQ (cq.popBulk (out, 3), 3UL);
+
+  for (auto& t : producers)
+  {
+    t.join ();
+  }
+  EXPECT_EQ (cq.size (), 3UL);
+}
+
+TEST(Int,ShutdownWakesAllConsumers)
+{
+  cdn::container::CircularQueue<int, 3> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::atomic<int> shutdowns (0);
+  std::vector<std::thread> consumers;
+  for (int i=0; i < 3; ++i)
+  {
+    consumers.emplace_back ([&] 
+                            { 
+                              try
+                              {
+                                cq.pop ();
+                              }
+                              catch (const cdn::container::CircularQueueShutdown&)
+                              {
+                                ++shutdowns;
+                              }
+                            });
+  }
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (250));
+  cq.shutdown ();
+
+  for (auto& t : consumers)
+  {
+    t.join ();
+  }
+  EXPECT_EQ (shutdowns.load (), 3);
+}
+
+TEST(Dynamic,Constructor)
+{
+  cdn::container::CircularQueue<int> cq (cdn::container::CircularQueueMode::BlockOnWrite,
+                                         cdn::container::CircularQueueCapacity (7));
+  EXPECT_EQ (cq.max (), 7UL);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Dynamic,ZeroCapacity)
+{
+  typedef cdn::container::CircularQueue<int> Queue;
+  EXPECT_THROW (Queue cq (cdn::container::CircularQueueMode::BlockOnWrite,
+                          cdn::container::CircularQueueCapacity (0)),
+                cdn::container::CircularQueueError);
+}
+
+TEST(Dynamic,CapacityOverflow)
+{
+  // sizeof (std::uint64_t) * capacity does not fit in a std::size_t
+  typedef cdn::container::CircularQueue<std::uint64_t> Queue;
+  EXPECT_THROW (Queue cq (cdn::container::CircularQueueMode::BlockOnWrite,
+                          cdn::container::CircularQueueCapacity (SIZE_MAX / 4)),
+                cdn::container::CircularQueueError);
+}
+
+TEST(Dynamic,OverAligned)
+{
+  // operator new would only give max_align_t, every slot must honour alignof
+  struct alignas(64) Wide { int val; };
+  typedef cdn::container::CircularQueue<Wide> Queue;
+
+  for (int i=0; i < 50; ++i)
+  {
+    std::unique_ptr<char[]> pad (new char[i + 1]);
+    Queue cq (cdn::container::CircularQueueMode::FailOnWrite,
+              cdn::container::CircularQueueCapacity (3));
+    auto slots = cq.reserve (3);
+    ASSERT_EQ (slots.size (), 3UL);
+    for (std::size_t j=0; j < slots.size (); ++j)
+    {
+      EXPECT_EQ (reinterpret_cast<std::uintptr_t> (&slots[j]) % alignof (Wide), 0UL);
+    }
+  }
+}
+
+TEST(Dynamic,Wraparound)
+{
+  cdn::container::CircularQueue<int> cq (cdn::container::CircularQueueMode::FailOnWrite,
+                                         cdn::container::CircularQueueCapacity (3));
+  for (int i=0; i < 10; ++i)
+  {
+    cq.push (i);
+    cq.push (i + 100);
+    EXPECT_EQ (cq.pop (), i);
+    EXPECT_EQ (cq.pop (), i + 100);
+  }
+
+  cq.push (1);
+  cq.push (2);
+  cq.push (3);
+  EXPECT_EQ (cq.size (), 3UL);
+  EXPECT_THROW (cq.push (4), cdn::container::CircularQueueError);
+
+  cq.dump (std::cout);
+}
+
+TEST(Dynamic,NonBlocking)
+{
+  cdn::container::CircularQueue<std::string> cq (cdn::container::CircularQueueMode::NonBlockingWrite,
+                                                 cdn::container::CircularQueueCapacity (2));
+  cq.push ("one");
+  cq.push ("two");
+  cq.push ("three");
+  EXPECT_EQ (cq.pop (), "two");
+  EXPECT_EQ (cq.pop (), "three");
+}
+
+TEST(Dynamic,LargeQueue)
+{
+  // far too big to live on the stack as a std::array<>
+  const std::size_t slots = 1 << 20;
+  cdn::container::CircularQueue<std::uint64_t> cq (cdn::container::CircularQueueMode::FailOnWrite,
+                                                   cdn::container::CircularQueueCapacity (slots));
+  EXPECT_EQ (cq.max (), slots);
+
+  for (std::uint64_t i=0; i < slots; ++i)
+  {
+    cq.push (i);
+  }
+  EXPECT_EQ (cq.size (), slots);
+  EXPECT_EQ (cq.pop (), 0UL);
+}
+
+TEST(Dynamic,HugePages)
+{
+  // Falls back to the heap when no huge pages are available, either way the
+  // queue must behave the same
+  const std::size_t slots = 300000;
+  cdn::container::CircularQueue<std::uint64_t> cq (cdn::container::CircularQueueMode::BlockOnWrite,
+                                                   cdn::container::CircularQueueCapacity (slots, cdn::container::CircularQueueMemory::HugePages));
+  EXPECT_EQ (cq.max (), slots);
+
+  std::vector<std::uint64_t> in (slots);
+  for (std::size_t i=0; i < slots; ++i)
+  {
+    in[i] = i * 3;
+  }
+  cq.pushRange (in.begin (), in.end ());
+
+  std::vector<std::uint64_t> out;
+  EXPECT_EQ (cq.popAll (std::back_inserter (out)), slots);
+  EXPECT_EQ (out, in);
+}
+
+TEST(NoDefault,PushEmplacePop)
+{
+  cdn::container::CircularQueue<NoDefault, 3> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.push (NoDefault (1));
+  cq.emplace (2);
+  EXPECT_EQ (cq.size (), 2UL);
+
+  EXPECT_EQ (cq.pop ().val (), 1);
+  EXPECT_EQ (cq.pop ().val (), 2);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(NoDefault,Dynamic)
+{
+  cdn::container::CircularQueue<NoDefault> cq (cdn::container::CircularQueueMode::NonBlockingWrite,
+                                               cdn::container::CircularQueueCapacity (2));
+  cq.emplace (1);
+  cq.emplace (2);
+  cq.emplace (3);
+  EXPECT_EQ (cq.pop ().val (), 2);
+  EXPECT_EQ (cq.pop ().val (), 3);
+}
+
+TEST(NoDefault,ThrowingEmplaceLeavesQueueUnchanged)
+{
+  cdn::container::CircularQueue<NoDefault, 3> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.emplace (1);
+  EXPECT_THROW (cq.emplace (2, true), cdn::container::CircularQueueError);
+  EXPECT_EQ (cq.size (), 1UL);
+
+  cq.emplace (3);
+  EXPECT_EQ (cq.pop ().val (), 1);
+  EXPECT_EQ (cq.pop ().val (), 3);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Lifetime,PopDestroysSlot)
+{
+  auto sp = std::make_shared<int> (42);
+  cdn::container::CircularQueue<std::shared_ptr<int>, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.push (sp);
+  EXPECT_EQ (sp.use_count (), 2);
+
+  {
+    auto out = cq.pop ();
+    EXPECT_EQ (sp.use_count (), 2);
+  }
+  // nothing left behind in the slot
+  EXPECT_EQ (sp.use_count (), 1);
+
+  cq.push (sp);
+  std::vector<std::shared_ptr<int>> out;
+  cq.popAll (std::back_inserter (out));
+  out.clear ();
+  EXPECT_EQ (sp.use_count (), 1);
+}
+
+TEST(Lifetime,NonBlockingDropDestroysOldest)
+{
+  auto oldest = std::make_shared<int> (1);
+  auto newest = std::make_shared<int> (2);
+  cdn::container::CircularQueue<std::shared_ptr<int>, 2> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  cq.push (oldest);
+  cq.push (newest);
+  cq.push (newest);
+  EXPECT_EQ (oldest.use_count (), 1);
+  EXPECT_EQ (newest.use_count (), 3);
+}
+
+TEST(Lifetime,DestructorDestroysRemaining)
+{
+  auto sp = std::make_shared<int> (7);
+  {
+    cdn::container::CircularQueue<std::shared_ptr<int>, 3> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+    // wrap the indices so the live slots straddle the end of the buffer
+    cq.push (sp);
+    cq.push (sp);
+    cq.pop ();
+    cq.pop ();
+    cq.push (sp);
+    cq.push (sp);
+    cq.push (sp);
+    EXPECT_EQ (sp.use_count (), 4);
+  }
+  EXPECT_EQ (sp.use_count (), 1);
+}
+
+TEST(PowerOfTwo,RingIndex)
+{
+  static_assert (cdn::container::RingIndex<8>::slot (13) == 5, "mask");
+  static_assert (cdn::container::RingIndex<6>::slot (13) == 1, "modulo");
+  EXPECT_EQ (cdn::container::RingIndex<1>::slot (12345), 0UL);
+}
+
+TEST(PowerOfTwo,FullEmptyAcrossWraps)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  for (int round=0; round < 10; ++round)
+  {
+    for (int i=0; i < 4; ++i)
+    {
+      cq.push (round * 4 + i);
+      EXPECT_EQ (cq.size (), static_cast<std::size_t> (i + 1));
+    }
+    EXPECT_THROW (cq.push (-1), cdn::container::CircularQueueError);
+
+    // pop one less than we pushed so head and tail drift through the slots
+    for (int i=0; i < 3; ++i)
+    {
+      EXPECT_EQ (cq.pop (), round * 4 + i);
+    }
+    EXPECT_EQ (cq.size (), 1UL);
+    EXPECT_EQ (cq.pop (), round * 4 + 3);
+    EXPECT_TRUE (cq.isEmpty ());
+  }
+}
+
+TEST(PowerOfTwo,NonBlockingOverwrite)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  for (int i=0; i < 11; ++i)
+  {
+    cq.push (i);
+  }
+  EXPECT_EQ (cq.size (), 4UL);
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, std::vector<int> ({ 7, 8, 9, 10 }));
+}
+
+TEST(PowerOfTwo,Dynamic)
+{
+  cdn::container::CircularQueue<int> cq (cdn::container::CircularQueueMode::FailOnWrite,
+                                         cdn::container::CircularQueueCapacity (8));
+  for (int i=0; i < 20; ++i)
+  {
+    std::vector<int> in { i, i + 1, i + 2, i + 3, i + 4 };
+    cq.pushRange (in.begin (), in.end ());
+
+    std::vector<int> out;
+    EXPECT_EQ (cq.popAll (std::back_inserter (out)), 5UL);
+    EXPECT_EQ (out, in);
+  }
+}
+
+namespace
+{
+
+struct Packet
+{
+  std::uint32_t length;
+  char          data[60];
+};
+
+} // namespace
+
+TEST(Reserve,CommitSingle)
+{
+  cdn::container::CircularQueue<Packet, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  {
+    auto slot = cq.reserve ();
+    EXPECT_EQ (slot.size (), 1UL);
+    slot->length = 5;
+    std::memcpy (slot->data, "hello", 5);
+    slot.commit ();
+    EXPECT_EQ (slot.size (), 0UL);
+  }
+
+  EXPECT_EQ (cq.size (), 1UL);
+  auto p = cq.pop ();
+  EXPECT_EQ (p.length, 5U);
+  EXPECT_EQ (std::string (p.data, p.length), "hello");
+}
+
+TEST(Reserve,UncommittedRollsBack)
+{
+  auto sp = std::make_shared<int> (1);
+  cdn::container::CircularQueue<std::shared_ptr<int>, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  {
+    auto slots = cq.reserve (3);
+    EXPECT_EQ (slots.size (), 3UL);
+    for (auto& s : slots)
+    {
+      s = sp;
+    }
+    EXPECT_EQ (sp.use_count (), 4);
+  }
+
+  EXPECT_EQ (sp.use_count (), 1);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Reserve,PushWhileReservedFails)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  {
+    auto slot = cq.reserve ();
+    *slot = 1;
+    // the lock is recursive, a push from this thread would land in the slot
+    EXPECT_THROW (cq.push (2), cdn::container::CircularQueueError);
+    EXPECT_THROW (cq.tryPush (2), cdn::container::CircularQueueError);
+    EXPECT_THROW (cq.reserve (), cdn::container::CircularQueueError);
+    slot.commit ();
+  }
+
+  cq.push (3);
+  EXPECT_EQ (cq.pop (), 1);
+  EXPECT_EQ (cq.pop (), 3);
+
+  {
+    auto slot = cq.reserve ();
+  }
+  // rolled back, pushes work again
+  cq.push (4);
+  EXPECT_EQ (cq.pop (), 4);
+}
+
+TEST(Reserve,BatchStopsAtWrap)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  // move the tail to slot 6
+  for (int i=0; i < 6; ++i)
+  {
+    cq.push (i);
+    cq.pop ();
+  }
+
+  auto slots = cq.reserve (5);
+  EXPECT_EQ (slots.size (), 2UL);
+  slots[0] = 60;
+  slots[1] = 61;
+  slots.commit ();
+
+  auto more = cq.reserve (5);
+  EXPECT_EQ (more.size (), 5UL);
+  std::iota (more.begin (), more.end (), 62);
+  more.commit ();
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, std::vector<int> ({ 60, 61, 62, 63, 64, 65, 66 }));
+}
+
+TEST(Reserve,PartialCommit)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  auto slots = cq.reserve (4);
+  slots[0] = 1;
+  slots[1] = 2;
+  slots.commit (2);
+
+  EXPECT_EQ (cq.size (), 2UL);
+  EXPECT_EQ (cq.pop (), 1);
+  EXPECT_EQ (cq.pop (), 2);
+}
+
+TEST(Reserve,LimitedByRoom)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (1);
+  cq.push (2);
+  cq.push (3);
+
+  auto slots = cq.reserve (4);
+  EXPECT_EQ (slots.size (), 1UL);
+  *slots = 4;
+  slots.commit ();
+
+  EXPECT_THROW (cq.reserve (), cdn::container::CircularQueueError);
+  EXPECT_THROW (cq.reserve (0), cdn::container::CircularQueueError);
+}
+
+TEST(Reserve,NonBlockingDropsOldest)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+  for (int i=0; i < 4; ++i)
+  {
+    cq.push (i);
+  }
+
+  auto slots = cq.reserve (2);
+  EXPECT_EQ (slots.size (), 2UL);
+  slots[0] = 10;
+  slots[1] = 11;
+  slots.commit ();
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, std::vector<int> ({ 2, 3, 10, 11 }));
+}
+
+TEST(Reserve,CommitWakesConsumer)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread consumer ([&] { EXPECT_EQ (cq.pop (), 99); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+  auto slot = cq.reserve ();
+  *slot = 99;
+  slot.commit ();
+
+  consumer.join ();
+}
+
+TEST(Peek,SingleSpan)
+{
+  cdn::container::CircularQueue<Packet, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  auto slot = cq.reserve ();
+  slot->length = 3;
+  std::memcpy (slot->data, "abc", 3);
+  slot.commit ();
+
+  auto view = cq.peek ();
+  EXPECT_EQ (view.size (), 1UL);
+  EXPECT_TRUE (view.second ().empty ());
+  EXPECT_EQ (std::string (view[0].data, view[0].length), "abc");
+  view.consume (1);
+  EXPECT_TRUE (view.empty ());
+
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+TEST(Peek,SpansWrap)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  // move the head to slot 6
+  for (int i=0; i < 6; ++i)
+  {
+    cq.push (i);
+    cq.pop ();
+  }
+  for (int i=60; i < 65; ++i)
+  {
+    cq.push (i);
+  }
+
+  auto view = cq.peek ();
+  EXPECT_EQ (view.size (), 5UL);
+  EXPECT_EQ (std::vector<int> (view.first ().begin (), view.first ().end ()),
+             std::vector<int> ({ 60, 61 }));
+  EXPECT_EQ (std::vector<int> (view.second ().begin (), view.second ().end ()),
+             std::vector<int> ({ 62, 63, 64 }));
+  for (std::size_t i=0; i < view.size (); ++i)
+  {
+    EXPECT_EQ (view[i], 60 + static_cast<int> (i));
+  }
+  view.consume (3);
+
+  EXPECT_EQ (cq.size (), 2UL);
+  EXPECT_EQ (cq.pop (), 63);
+  EXPECT_EQ (cq.pop (), 64);
+}
+
+TEST(Peek,UnconsumedStays)
+{
+  auto sp = std::make_shared<int> (1);
+  cdn::container::CircularQueue<std::shared_ptr<int>, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (sp);
+  cq.push (sp);
+
+  {
+    auto view = cq.peek ();
+    EXPECT_EQ (view.size (), 2UL);
+    EXPECT_EQ (view[1].get (), sp.get ());
+  }
+
+  EXPECT_EQ (cq.size (), 2UL);
+  EXPECT_EQ (sp.use_count (), 3);
+
+  cq.peek ().consume (10);
+  EXPECT_TRUE (cq.isEmpty ());
+  EXPECT_EQ (sp.use_count (), 1);
+}
+
+TEST(Peek,Timeout)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  auto view = cq.peek (std::chrono::milliseconds (50));
+  EXPECT_TRUE (view.empty ());
+  view.consume (1);
+
+  cq.push (7);
+  EXPECT_EQ (cq.peek (std::chrono::milliseconds (50))[0], 7);
+}
+
+TEST(Peek,ConsumeWakesProducer)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+  cq.push (1);
+  cq.push (2);
+
+  std::thread producer ([&] { cq.push (3); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+  cq.peek ().consume (1);
+  producer.join ();
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, std::vector<int> ({ 2, 3 }));
+}
+
+TEST(Peek,Shutdown)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread consumer ([&] { EXPECT_THROW (cq.peek (), cdn::container::CircularQueueShutdown); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+  cq.shutdown ();
+  consumer.join ();
+}
+
+TEST(Latency,RecordsPoppedElements)
+{
+  cdn::container::CircularQueue<int, 8, cdn::container::TrackLatency> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.push (1);
+  cq.emplace (2);
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+  cq.pop ();
+  cq.pop ();
+
+  auto h = cq.latencySnapshot ();
+  EXPECT_EQ (h.count (), 2UL);
+  EXPECT_GE (h.min (), 20000000UL);
+  EXPECT_LT (h.max (), 20000000000UL);
+}
+
+TEST(Latency,EveryPopPath)
+{
+  cdn::container::CircularQueue<int, cdn::container::DynamicCapacity, cdn::container::TrackLatency> 
+    cq (cdn::container::CircularQueueMode::FailOnWrite, cdn::container::CircularQueueCapacity (8));
+
+  std::vector<int> in ({ 1, 2, 3, 4 });
+  cq.pushRange (in.begin (), in.end ());
+  auto slots = cq.reserve (2);
+  slots.commit ();
+
+  std::vector<int> out;
+  int val = 0;
+  cq.pop ();
+  EXPECT_EQ (cq.tryPop (val), cdn::container::CircularQueueStatus::Ok);
+  cq.popBulk (std::back_inserter (out), 1);
+  cq.peek ().consume (1);
+  cq.popAll (std::back_inserter (out));
+
+  EXPECT_EQ (cq.latencySnapshot ().count (), 6UL);
+}
+
+TEST(Latency,DroppedAndUncommittedNotCounted)
+{
+  cdn::container::CircularQueue<int, 2, cdn::container::TrackLatency> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  cq.push (1);
+  cq.push (2);
+  cq.push (3);
+  {
+    // makes room by dropping 2, but is never committed
+    auto slot = cq.reserve ();
+  }
+  cq.peek ();
+
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+  EXPECT_EQ (out, std::vector<int> ({ 3 }));
+  EXPECT_EQ (cq.latencySnapshot ().count (), 1UL);
+}
+
+TEST(Latency,SnapshotReset)
+{
+  cdn::container::CircularQueue<int, 4, cdn::container::TrackLatency> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  cq.push (1);
+  cq.pop ();
+  EXPECT_EQ (cq.latencySnapshot (true).count (), 1UL);
+  EXPECT_EQ (cq.latencySnapshot ().count (), 0UL);
+
+  cq.push (2);
+  cq.pop ();
+  EXPECT_EQ (cq.latencySnapshot ().count (), 1UL);
+}
+
+TEST(Latency,DisabledCostsNoSpace)
+{
+  EXPECT_EQ (sizeof (cdn::container::CircularQueue<int, 64>),
+             sizeof (cdn::container::CircularQueue<int, 64, cdn::container::NoLatencyTracking>));
+  EXPECT_LT (sizeof (cdn::container::CircularQueue<int, 64>),
+             sizeof (cdn::container::CircularQueue<int, 64, cdn::container::TrackLatency>));
+}
+
+TEST(Stats,PushPopOverwrite)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  for (int i=0; i < 6; ++i)
+  {
+    cq.push (i);
+  }
+  std::vector<int> in ({ 6, 7 });
+  cq.pushRange (in.begin (), in.end ());
+  auto slot = cq.reserve ();
+  slot.commit ();
+
+  cq.pop ();
+  cq.peek ().consume (1);
+  std::vector<int> out;
+  cq.popAll (std::back_inserter (out));
+
+  auto st = cq.stats ();
+  EXPECT_EQ (st.pushes, 9UL);
+  EXPECT_EQ (st.overwritten, 5UL);
+  EXPECT_EQ (st.pops, 4UL);
+  EXPECT_EQ (st.highWaterMark, 4UL);
+  EXPECT_EQ (st.capacity, 4UL);
+  EXPECT_EQ (st.fullWaits, 0UL);
+  EXPECT_EQ (st.emptyWaits, 0UL);
+}
+
+TEST(Stats,HighWaterMark)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  // one element at a time, well past the capacity
+  for (int i=0; i < 20; ++i)
+  {
+    cq.push (i);
+    cq.pop ();
+  }
+  EXPECT_EQ (cq.stats ().highWaterMark, 1UL);
+
+  for (int i=0; i < 3; ++i)
+  {
+    cq.push (i);
+  }
+  cq.pop ();
+  cq.pop ();
+  for (int i=0; i < 4; ++i)
+  {
+    cq.push (i);
+  }
+  EXPECT_EQ (cq.stats ().highWaterMark, 5UL);
+}
+
+TEST(Stats,Waits)
+{
+  cdn::container::CircularQueue<int, 1> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  // one timed out wait on the empty queue
+  EXPECT_FALSE (cq.pop (std::chrono::milliseconds (20)));
+
+  cq.push (1);
+  std::thread producer ([&] { cq.push (2); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+  cq.pop ();
+  producer.join ();
+  cq.pop ();
+
+  auto st = cq.stats ();
+  EXPECT_EQ (st.emptyWaits, 1UL);
+  EXPECT_GE (st.consumerWaitNs, 20000000UL);
+  EXPECT_EQ (st.fullWaits, 1UL);
+  EXPECT_GE (st.producerWaitNs, 10000000UL);
+  EXPECT_EQ (st.pushes, 2UL);
+  EXPECT_EQ (st.pops, 2UL);
+}
+
+TEST(Stats,LockContended)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  // the reservation holds the lock while another thread pushes
+  auto slot = cq.reserve ();
+  std::thread producer ([&] { cq.push (1); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+  slot.commit ();
+  producer.join ();
+
+  EXPECT_GE (cq.stats ().lockContended, 1UL);
+}
+
+TEST(Stats,Prometheus)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (1);
+  cq.push (2);
+  cq.pop ();
+
+  std::ostringstream strm;
+  cq.writeStats (strm, "orders");
+  auto text = strm.str ();
+  EXPECT_NE (text.find ("# TYPE cdn_queue_pushes_total counter\n"), std::string::npos);
+  EXPECT_NE (text.find ("cdn_queue_pushes_total{queue=\"orders\"} 2\n"), std::string::npos);
+  EXPECT_NE (text.find ("cdn_queue_pops_total{queue=\"orders\"} 1\n"), std::string::npos);
+  EXPECT_NE (text.find ("cdn_queue_high_water_mark{queue=\"orders\"} 2\n"), std::string::npos);
+  EXPECT_NE (text.find ("cdn_queue_capacity{queue=\"orders\"} 4\n"), std::string::npos);
+
+  std::ostringstream bare;
+  cq.writeStats (bare, "orders", false);
+  EXPECT_EQ (bare.str ().find ("# "), std::string::npos);
+}
+
+namespace
+{
+
+// Push count elements through a tiny BlockOnWrite queue so both the consumer
+// and the producer have to wait
+template <typename Wait>
+void
+handOff (int count)
+{
+  cdn::container::CircularQueue<int, 4, cdn::container::NoLatencyTracking, Wait> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  long long sum = 0;
+  std::thread consumer ([&]
+                        {
+                          for (int i=0; i < count; ++i)
+                          {
+                            sum += cq.pop ();
+                          }
+                        });
+  for (int i=0; i < count; ++i)
+  {
+    cq.push (i);
+  }
+  consumer.join ();
+
+  EXPECT_EQ (sum, static_cast<long long> (count) * (count - 1) / 2);
+  EXPECT_TRUE (cq.isEmpty ());
+}
+
+template <typename Wait>
+void
+shutdownReleasesWaiters ()
+{
+  cdn::container::CircularQueue<int, 1, cdn::container::NoLatencyTracking, Wait> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+  cq.push (0);
+
+  cdn::container::CircularQueue<int, 1, cdn::container::NoLatencyTracking, Wait> empty (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread producer ([&] { EXPECT_THROW (cq.push (1), cdn::container::CircularQueueShutdown); });
+  std::thread consumer ([&] { EXPECT_THROW (empty.pop (), cdn::container::CircularQueueShutdown); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+  cq.shutdown ();
+  empty.shutdown ();
+  producer.join ();
+  consumer.join ();
+}
+
+template <typename Wait>
+void
+timedPop ()
+{
+  cdn::container::CircularQueue<int, 4, cdn::container::NoLatencyTracking, Wait> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_FALSE (cq.pop (std::chrono::milliseconds (50)));
+  EXPECT_GE (std::chrono::steady_clock::now () - start, std::chrono::milliseconds (50));
+  EXPECT_FALSE (cq.pop (std::chrono::milliseconds (0)));
+
+  std::thread producer ([&]
+                        {
+                          std::this_thread::sleep_for (std::chrono::milliseconds (20));
+                          cq.push (5);
+                        });
+  auto v = cq.pop (std::chrono::seconds (5));
+  producer.join ();
+  ASSERT_TRUE (static_cast<bool> (v));
+  EXPECT_EQ (v.get (), 5);
+}
+
+} // namespace
+
+TEST(Wait,Blocking)
+{
+  handOff<cdn::container::BlockingWait> (20000);
+  shutdownReleasesWaiters<cdn::container::BlockingWait> ();
+  timedPop<cdn::container::BlockingWait> ();
+}
+
+TEST(Wait,BusySpin)
+{
+  // a spinning thread only gives up the core at the end of its time slice,
+  // keep this short for machines with a single core
+  handOff<cdn::container::BusySpinWait> (500);
+  shutdownReleasesWaiters<cdn::container::BusySpinWait> ();
+  timedPop<cdn::container::BusySpinWait> ();
+}
+
+TEST(Wait,SpinYield)
+{
+  handOff<cdn::container::SpinYieldWait> (20000);
+  shutdownReleasesWaiters<cdn::container::SpinYieldWait> ();
+  timedPop<cdn::container::SpinYieldWait> ();
+}
+
+TEST(Wait,SpinPark)
+{
+  handOff<cdn::container::SpinParkWait> (20000);
+  shutdownReleasesWaiters<cdn::container::SpinParkWait> ();
+  timedPop<cdn::container::SpinParkWait> ();
+}
+
+TEST(Wait,SpinParkParksAfterBudget)
+{
+  cdn::container::CircularQueue<int, 4, cdn::container::NoLatencyTracking, cdn::container::SpinParkWait> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  // long enough for the spin budget to run out, the push has to notify the
+  // parked consumer
+  std::thread consumer ([&] { EXPECT_EQ (cq.pop (), 3); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (200));
+  cq.push (3);
+  consumer.join ();
+
+  EXPECT_EQ (cq.stats ().emptyWaits, 1UL);
+}
+
+namespace
+{
+
+bool
+readable (int fd)
+{
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  return ::poll (&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+} // namespace
+
+TEST(Readiness,ClearBeforeFd)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (1);
+  // no descriptor yet, nothing to clear
+  EXPECT_FALSE (cq.clearReadiness ());
+}
+
+TEST(Readiness,EmptyToNotEmpty)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  int fd = cq.readinessFd ();
+  EXPECT_EQ (cq.readinessFd (), fd);
+  EXPECT_FALSE (readable (fd));
+  EXPECT_FALSE (cq.clearReadiness ());
+
+  cq.push (1);
+  EXPECT_TRUE (readable (fd));
+  EXPECT_TRUE (cq.clearReadiness ());
+  EXPECT_FALSE (readable (fd));
+
+  // the queue was not empty, so no signal
+  cq.push (2);
+  EXPECT_FALSE (readable (fd));
+
+  std::vector<int> out;
+  EXPECT_EQ (cq.popAll (std::back_inserter (out)), 2U);
+  EXPECT_FALSE (readable (fd));
+
+  cq.emplace (3);
+  EXPECT_TRUE (readable (fd));
+}
+
+TEST(Readiness,FullToNotFull)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  int fd = cq.readinessFd ();
+
+  cq.push (1);
+  cq.push (2);
+  EXPECT_THROW (cq.push (3), cdn::container::CircularQueueError);
+  EXPECT_TRUE (cq.clearReadiness ());
+
+  int v = 0;
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_TRUE (readable (fd));
+  EXPECT_TRUE (cq.clearReadiness ());
+
+  // not full before this pop
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_FALSE (readable (fd));
+}
+
+TEST(Readiness,EveryPath)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  int fd = cq.readinessFd ();
+
+  std::vector<int> in = { 1, 2 };
+  cq.pushRange (in.begin (), in.end ());
+  EXPECT_TRUE (cq.clearReadiness ());
+
+  cq.peek ().consume (1);
+  EXPECT_TRUE (cq.clearReadiness ());
+
+  cq.pop ();
+  EXPECT_FALSE (readable (fd));
+
+  auto r = cq.reserve ();
+  *r = 4;
+  EXPECT_FALSE (readable (fd));
+  r.commit ();
+  EXPECT_TRUE (cq.clearReadiness ());
+}
+
+TEST(Readiness,CreatedLate)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  cq.push (1);
+
+  // nobody saw the push, so the descriptor starts out readable
+  EXPECT_TRUE (readable (cq.readinessFd ()));
+}
+
+TEST(Readiness,Shutdown)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+  int fd = cq.readinessFd ();
+
+  cq.shutdown ();
+  EXPECT_TRUE (readable (fd));
+  int v = 0;
+  EXPECT_EQ (cq.tryPop (v), cdn::container::CircularQueueStatus::Shutdown);
+}
+
+TEST(Readiness,Epoll)
+{
+  const int count = 10000;
+  cdn::container::CircularQueue<int> cq (cdn::container::CircularQueueMode::BlockOnWrite,
+                                         cdn::container::CircularQueueCapacity (64));
+
+  int ep = ::epoll_create1 (0);
+  ASSERT_GE (ep, 0);
+  struct epoll_event ev;
+  std::memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ASSERT_EQ (::epoll_ctl (ep, EPOLL_CTL_ADD, cq.readinessFd (), &ev), 0);
+
+  std::thread producer ([&]
+                        {
+                          for (int i=0; i < count; ++i)
+                          {
+                            cq.push (i);
+                          }
+                          cq.shutdown ();
+                        });
+
+  // clear first and then drain, a push after the drain raises it again
+  std::vector<int> out;
+  bool done = false;
+  while (! done)
+  {
+    struct epoll_event got;
+    ASSERT_EQ (::epoll_wait (ep, &got, 1, 5000), 1);
+    cq.clearReadiness ();
+    try
+    {
+      while (cq.popAll (std::back_inserter (out)) > 0)
+      { }
+    }
+    catch (const cdn::container::CircularQueueShutdown&)
+    {
+      done = true;
+    }
+  }
+  producer.join ();
+  ::close (ep);
+
+  ASSERT_EQ (out.size (), static_cast<std::size_t> (count));
+  for (int i=0; i < count; ++i)
+  {
+    EXPECT_EQ (out[i], i);
+  }
+}
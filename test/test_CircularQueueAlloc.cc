@@ -0,0 +1,345 @@
+// test_CircularQueueAlloc.cc
+//
+// Replaces the global operator new/delete so the steady state CircularQueue
+// operations can be checked for heap allocations. This lives in its own
+// executable since the replacement applies to the whole program.
+
+#include "CircularQueue.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+// Only allocations made by the armed thread are counted, gtest and any 
+// helper threads are free to allocate
+thread_local bool      t_armed = false;
+thread_local std::size_t t_allocations = 0;
+
+void*
+countedAlloc (std::size_t sz)
+{
+  if (t_armed)
+  {
+    ++t_allocations;
+  }
+  void* p = std::malloc (sz == 0 ? 1 : sz);
+  if (p == nullptr)
+  {
+    throw std::bad_alloc ();
+  }
+  return p;
+}
+
+//! Count the allocations made by the current thread while in scope
+class AllocationCounter
+{
+public:
+  AllocationCounter ()
+  { 
+    t_allocations = 0;
+    t_armed = true;
+  }
+
+  ~AllocationCounter ()
+  {
+    t_armed = false;
+  }
+
+  std::size_t
+  count ()
+    const
+  { return t_allocations; }
+};
+
+} // namespace
+
+void* operator new (std::size_t sz)
+{
+  return countedAlloc (sz);
+}
+
+void* operator new[] (std::size_t sz)
+{
+  return countedAlloc (sz);
+}
+
+void* operator new (std::size_t sz, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return countedAlloc (sz);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void* operator new[] (std::size_t sz, const std::nothrow_t&) noexcept
+{
+  try
+  {
+    return countedAlloc (sz);
+  }
+  catch (...)
+  {
+    return nullptr;
+  }
+}
+
+void operator delete (void* p) noexcept
+{
+  std::free (p);
+}
+
+void operator delete[] (void* p) noexcept
+{
+  std::free (p);
+}
+
+void operator delete (void* p, std::size_t) noexcept
+{
+  std::free (p);
+}
+
+void operator delete[] (void* p, std::size_t) noexcept
+{
+  std::free (p);
+}
+
+
+TEST(Harness,CountsAllocations)
+{
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    std::unique_ptr<int> p (new int (5));
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 1UL);
+}
+
+TEST(Int,PushPop)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+      const int v = i + 1;
+      cq.push (v);
+      cq.emplace (i + 2);
+      cq.pop ();
+      cq.pop ();
+      cq.pop ();
+      cq.isEmpty ();
+      cq.size ();
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,ReserveCommit)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      auto slot = cq.reserve ();
+      *slot = i;
+      slot.commit ();
+
+      auto slots = cq.reserve (3);
+      slots.commit ();
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,PeekConsume)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+      cq.push (i);
+
+      auto view = cq.peek ();
+      view.consume (view.size ());
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,TrackLatency)
+{
+  cdn::container::CircularQueue<int, 8, cdn::container::TrackLatency> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+      cq.pop ();
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+  EXPECT_EQ (cq.latencySnapshot ().count (), 100UL);
+}
+
+TEST(Int,Stats)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+    }
+    cq.pop ();
+    auto st = cq.stats ();
+    EXPECT_EQ (st.overwritten, 92UL);
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,TimedPopAndTryPop)
+{
+  cdn::container::CircularQueue<int, 8> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    int out = 0;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+      cq.pop (std::chrono::milliseconds (1));
+      cq.push (i);
+      cq.tryPop (out);
+      cq.tryPop (out);
+    }
+    // timeout with nothing to pop
+    cq.pop (std::chrono::milliseconds (1));
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,NonBlockingOverwrite)
+{
+  cdn::container::CircularQueue<int, 4> cq (cdn::container::CircularQueueMode::NonBlockingWrite);
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.push (i);
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,Bulk)
+{
+  cdn::container::CircularQueue<int, 16> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  int in[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  int out[16] = { };
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < 100; ++i)
+    {
+      cq.pushRange (in, in + 10);
+      cq.popBulk (out, 4);
+      cq.popBulk (out, 4, std::chrono::milliseconds (1));
+      cq.popAll (out);
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(UniquePtr,MoveThrough)
+{
+  cdn::container::CircularQueue<std::unique_ptr<int>, 4> cq (cdn::container::CircularQueueMode::FailOnWrite);
+
+  // allocate the payload up front, the queue must not add to it
+  std::vector<std::unique_ptr<int>> payload;
+  for (int i=0; i < 100; ++i)
+  {
+    payload.emplace_back (new int (i));
+  }
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (auto& p : payload)
+    {
+      cq.push (std::move (p));
+      p = cq.pop ();
+    }
+    allocations = counter.count ();
+  }
+  EXPECT_EQ (allocations, 0UL);
+}
+
+TEST(Int,BlockingHandoff)
+{
+  cdn::container::CircularQueue<int, 2> cq (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  const int count = 1000;
+
+  // the consumer is not armed, but it forces the producer through the
+  // BlockOnWrite wait path
+  std::thread consumer ([&]
+                        {
+                          for (int i=0; i < count; ++i)
+                          {
+                            cq.pop ();
+                          }
+                        });
+
+  std::size_t allocations = 0;
+  {
+    AllocationCounter counter;
+    for (int i=0; i < count; ++i)
+    {
+      cq.push (i);
+    }
+    allocations = counter.count ();
+  }
+  consumer.join ();
+
+  EXPECT_EQ (allocations, 0UL);
+}
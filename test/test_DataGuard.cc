@@ -166,3 +166,23 @@ TEST(Int,CondVarAny)
   
   fut.get ();
 }
+
+TEST(Int,TryToLock)
+{
+  cdn::thread::DataGuard<int> dg (7);
+
+  auto lock = cdn::thread::lockDataGuard (dg);
+
+  auto fut = std::async (std::launch::async,
+                         [&]
+                         {
+                           std::unique_lock<cdn::thread::DataGuard<int>> other (dg, std::try_to_lock);
+                           return other.owns_lock ();
+                         });
+  EXPECT_FALSE (fut.get ());
+
+  lock.unlock ();
+  std::unique_lock<cdn::thread::DataGuard<int>> again (dg, std::try_to_lock);
+  EXPECT_TRUE (again.owns_lock ());
+  EXPECT_EQ (7, dg (again));
+}
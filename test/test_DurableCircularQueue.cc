@@ -0,0 +1,353 @@
+// test_DurableCircularQueue.cc
+
+#include "DurableCircularQueue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+using cdn::container::CircularQueueError;
+using cdn::container::CircularQueueMode;
+using cdn::container::CircularQueueShutdown;
+using cdn::container::DurableCircularQueue;
+using cdn::container::JournalFlush;
+using cdn::container::JournalFlushPolicy;
+
+struct Order
+{
+  std::uint64_t id;
+  double        price;
+};
+
+// A file name no other test run uses, removed again at the end of the test
+class JournalPath
+{
+public:
+  JournalPath ()
+    : m_path ("/tmp/cdn_journal_" + std::to_string (::getpid ()) + "_" + std::to_string (s_next++))
+  {
+    std::remove (m_path.c_str ());
+  }
+
+  ~JournalPath ()
+  {
+    std::remove (m_path.c_str ());
+  }
+
+  operator const std::string& ()
+    const
+  { return m_path; }
+
+private:
+  static int  s_next;
+  std::string m_path;
+};
+
+int JournalPath::s_next = 0;
+
+// Run body in a child process, body leaks the queue it opens so the child
+// exits without closing it, as in a crash
+template <typename Body>
+void
+crashAfter (Body body)
+{
+  pid_t child = ::fork ();
+  ASSERT_NE (-1, child);
+  if (child == 0)
+  {
+    try
+    {
+      body ();
+    }
+    catch (...)
+    {
+      ::_exit (1);
+    }
+    ::_exit (0);
+  }
+
+  int status = 0;
+  ::waitpid (child, &status, 0);
+  ASSERT_TRUE (WIFEXITED (status));
+  ASSERT_EQ (0, WEXITSTATUS (status));
+}
+
+// Overwrite one byte of the file
+void
+corrupt (const std::string& path, off_t offset)
+{
+  int fd = ::open (path.c_str (), O_WRONLY);
+  ASSERT_LE (0, fd);
+  char junk = 0x5a;
+  ASSERT_EQ (1, ::pwrite (fd, &junk, 1, offset));
+  ::close (fd);
+}
+
+} // namespace
+
+
+TEST(DurableCircularQueue,PushPop)
+{
+  JournalPath path;
+  DurableCircularQueue<Order> q (path, CircularQueueMode::FailOnWrite, 4);
+
+  EXPECT_TRUE (q.isEmpty ());
+  EXPECT_EQ (4u, q.max ());
+  EXPECT_EQ (0u, q.recovered ());
+
+  for (std::uint64_t i=0; i < 10; ++i)
+  {
+    q.push (Order { i, i * 0.5 });
+    q.emplace (Order { i + 100, 0.0 });
+    EXPECT_EQ (2u, q.size ());
+
+    auto first = q.pop ();
+    EXPECT_EQ (i, first.id);
+    EXPECT_EQ (i * 0.5, first.price);
+
+    Order second;
+    EXPECT_TRUE (q.tryPop (second));
+    EXPECT_EQ (i + 100, second.id);
+  }
+
+  Order none;
+  EXPECT_FALSE (q.tryPop (none));
+  EXPECT_FALSE (q.pop (std::chrono::milliseconds (1)));
+}
+
+TEST(DurableCircularQueue,Restart)
+{
+  const JournalFlush flushes[] = { JournalFlush (JournalFlushPolicy::None),
+                                   JournalFlush (JournalFlushPolicy::Periodic, std::chrono::milliseconds (50)),
+                                   JournalFlush (JournalFlushPolicy::Batch, std::chrono::milliseconds (0), 16) };
+
+  for (auto& flush : flushes)
+  {
+    JournalPath path;
+    {
+      DurableCircularQueue<int> q (path, CircularQueueMode::BlockOnWrite, 8, flush);
+      for (int i=0; i < 5; ++i)
+      {
+        q.push (i);
+      }
+      EXPECT_EQ (0, q.pop ());
+      EXPECT_EQ (1, q.pop ());
+    }
+
+    DurableCircularQueue<int> q (path, CircularQueueMode::BlockOnWrite, 8, flush);
+    EXPECT_EQ (3u, q.recovered ());
+    EXPECT_EQ (3u, q.size ());
+    for (int i=2; i < 5; ++i)
+    {
+      EXPECT_EQ (i, q.pop ());
+    }
+    q.push (5);
+    EXPECT_EQ (5, q.pop ());
+  }
+}
+
+TEST(DurableCircularQueue,CrashWithoutFlush)
+{
+  JournalPath path;
+  crashAfter ([&]
+              {
+                auto& q = *new DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 16);
+                for (int i=0; i < 10; ++i)
+                {
+                  q.push (i);
+                }
+                q.pop ();
+                q.pop ();
+                q.pop ();
+              });
+
+  // The page cache outlives the process, only a machine crash loses it
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 16);
+  EXPECT_EQ (7u, q.recovered ());
+  for (int i=3; i < 10; ++i)
+  {
+    EXPECT_EQ (i, q.pop ());
+  }
+}
+
+TEST(DurableCircularQueue,CrashWithBatchFlush)
+{
+  JournalPath path;
+  JournalFlush flush (JournalFlushPolicy::Batch, std::chrono::milliseconds (0), 4);
+
+  crashAfter ([&]
+              {
+                auto& q = *new DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 16, flush);
+                for (int i=0; i < 10; ++i)
+                {
+                  q.push (i);
+                }
+              });
+
+  // Synced after the 4th and 8th push, the last two were not made durable
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 16, flush);
+  EXPECT_EQ (8u, q.recovered ());
+  for (int i=0; i < 8; ++i)
+  {
+    EXPECT_EQ (i, q.pop ());
+  }
+}
+
+TEST(DurableCircularQueue,CrashAfterWrap)
+{
+  JournalPath path;
+  JournalFlush flush (JournalFlushPolicy::Batch, std::chrono::milliseconds (0), 100);
+
+  crashAfter ([&]
+              {
+                auto& q = *new DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 4, flush);
+                std::vector<int> first { 0, 1, 2, 3 };
+                q.pushRange (first.begin (), first.end ());
+                for (int i=0; i < 4; ++i)
+                {
+                  q.pop ();
+                }
+                // Reusing the slots forces the pops into the header first
+                q.push (4);
+                q.push (5);
+              });
+
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4, flush);
+  EXPECT_EQ (0u, q.recovered ());
+}
+
+TEST(DurableCircularQueue,TornHeader)
+{
+  JournalPath path;
+  {
+    // Formatting writes the first header copy, every push the other one
+    DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+    q.push (1);
+    q.push (2);
+  }
+
+  // Damage the newest copy, the older one holds the state one push earlier
+  corrupt (path, 512 + 48);
+  {
+    DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+    EXPECT_EQ (1u, q.recovered ());
+    EXPECT_EQ (1, q.pop ());
+  }
+
+  // Popping rewrote the damaged copy, now damage both
+  corrupt (path, 48);
+  corrupt (path, 512 + 48);
+  EXPECT_THROW ((DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 4)),
+                CircularQueueError);
+}
+
+TEST(DurableCircularQueue,Mismatch)
+{
+  JournalPath path;
+  {
+    DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+    q.push (1);
+  }
+
+  EXPECT_THROW ((DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 8)),
+                CircularQueueError);
+  EXPECT_THROW ((DurableCircularQueue<int> (path, CircularQueueMode::BlockOnWrite, 4)),
+                CircularQueueError);
+  EXPECT_THROW ((DurableCircularQueue<Order> (path, CircularQueueMode::FailOnWrite, 4)),
+                CircularQueueError);
+  EXPECT_THROW ((DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 0)),
+                CircularQueueError);
+
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+  EXPECT_EQ (1, q.pop ());
+}
+
+TEST(DurableCircularQueue,InUse)
+{
+  JournalPath path;
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+  EXPECT_THROW ((DurableCircularQueue<int> (path, CircularQueueMode::FailOnWrite, 4)),
+                CircularQueueError);
+}
+
+TEST(DurableCircularQueue,NonBlockingWrite)
+{
+  JournalPath path;
+  {
+    DurableCircularQueue<int> q (path, CircularQueueMode::NonBlockingWrite, 4);
+    for (int i=0; i < 10; ++i)
+    {
+      q.push (i);
+    }
+    EXPECT_EQ (4u, q.size ());
+  }
+
+  DurableCircularQueue<int> q (path, CircularQueueMode::NonBlockingWrite, 4);
+  EXPECT_EQ (4u, q.recovered ());
+  for (int i=6; i < 10; ++i)
+  {
+    EXPECT_EQ (i, q.pop ());
+  }
+}
+
+TEST(DurableCircularQueue,PushRange)
+{
+  JournalPath path;
+  DurableCircularQueue<int> q (path, CircularQueueMode::FailOnWrite, 4);
+
+  std::vector<int> values { 0, 1, 2, 3, 4, 5 };
+  auto rest = q.pushRange (values.begin (), values.end ());
+  EXPECT_EQ (values.begin () + 4, rest);
+  EXPECT_EQ (4u, q.size ());
+  EXPECT_THROW (q.push (6), CircularQueueError);
+}
+
+TEST(DurableCircularQueue,BlockOnWrite)
+{
+  JournalPath path;
+  DurableCircularQueue<int> q (path, CircularQueueMode::BlockOnWrite, 2,
+                               JournalFlush (JournalFlushPolicy::Batch, std::chrono::milliseconds (0), 8));
+  const int count = 1000;
+
+  std::thread producer ([&]
+                        {
+                          for (int i=0; i < count; ++i)
+                          {
+                            q.push (i);
+                          }
+                        });
+
+  for (int i=0; i < count; ++i)
+  {
+    EXPECT_EQ (i, q.pop ());
+  }
+  producer.join ();
+  q.sync ();
+}
+
+TEST(DurableCircularQueue,Shutdown)
+{
+  JournalPath path;
+  DurableCircularQueue<int> q (path, CircularQueueMode::BlockOnWrite, 2);
+
+  std::thread consumer ([&]
+                        {
+                          EXPECT_THROW (q.pop (), CircularQueueShutdown);
+                        });
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+  q.shutdown ();
+  consumer.join ();
+
+  EXPECT_TRUE (q.isShutdown ());
+}
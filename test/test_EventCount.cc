@@ -0,0 +1,98 @@
+// test_EventCount.cc
+
+#include "EventCount.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+
+TEST(EventCount,DefaultConstructor)
+{
+  cdn::thread::EventCount ec;
+}
+
+TEST(EventCount,NotifyWithoutWaiters)
+{
+  cdn::thread::EventCount ec;
+  ec.notifyOne ();
+  ec.notifyAll ();
+}
+
+TEST(EventCount,CancelWait)
+{
+  cdn::thread::EventCount ec;
+  ec.prepareWait ();
+  ec.cancelWait ();
+}
+
+TEST(EventCount,PredicateAlreadyTrue)
+{
+  cdn::thread::EventCount ec;
+  ec.wait ([] { return true; });
+  EXPECT_TRUE (ec.waitFor (std::chrono::milliseconds (0), [] { return true; }));
+}
+
+TEST(EventCount,WaitForTimeout)
+{
+  cdn::thread::EventCount ec;
+  EXPECT_FALSE (ec.waitFor (std::chrono::milliseconds (150), [] { return false; }));
+}
+
+TEST(EventCount,NotifyBeforeCommit)
+{
+  cdn::thread::EventCount ec;
+  auto key = ec.prepareWait ();
+  ec.notifyOne ();
+  // the notify advanced the epoch so this must not block
+  ec.commitWait (key);
+}
+
+TEST(EventCount,WaitNotify)
+{
+  cdn::thread::EventCount ec;
+  std::atomic<bool> ready (false);
+
+  auto fut = std::async (std::launch::async,
+                         [&] 
+                         { 
+                           std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                           ready.store (true);
+                           ec.notifyOne ();
+                         });
+
+  ec.wait ([&] { return ready.load (); });
+  EXPECT_TRUE (ready.load ());
+
+  fut.get ();
+}
+
+TEST(EventCount,NotifyAll)
+{
+  cdn::thread::EventCount ec;
+  std::atomic<bool> ready (false);
+  std::atomic<int>  woken (0);
+
+  std::vector<std::thread> waiters;
+  for (int i=0; i < 4; ++i)
+  {
+    waiters.emplace_back ([&] 
+                          { 
+                            ec.wait ([&] { return ready.load (); });
+                            ++woken;
+                          });
+  }
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (250));
+  ready.store (true);
+  ec.notifyAll ();
+
+  for (auto& t : waiters)
+  {
+    t.join ();
+  }
+  EXPECT_EQ (woken.load (), 4);
+}
@@ -0,0 +1,68 @@
+// test_EventFd.cc
+
+#include "EventFd.h"
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include <poll.h>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+bool
+readable (int fd, int timeoutMs = 0)
+{
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  return ::poll (&pfd, 1, timeoutMs) == 1 && (pfd.revents & POLLIN);
+}
+
+} // namespace
+
+TEST(EventFd,DefaultConstructor)
+{
+  cdn::thread::EventFd efd;
+  EXPECT_GE (efd.fd (), 0);
+  EXPECT_FALSE (readable (efd.fd ()));
+}
+
+TEST(EventFd,SignalReset)
+{
+  cdn::thread::EventFd efd;
+  EXPECT_FALSE (efd.reset ());
+
+  efd.signal ();
+  EXPECT_TRUE (readable (efd.fd ()));
+  EXPECT_TRUE (efd.reset ());
+  EXPECT_FALSE (readable (efd.fd ()));
+  EXPECT_FALSE (efd.reset ());
+}
+
+TEST(EventFd,SignalsCoalesce)
+{
+  cdn::thread::EventFd efd;
+  for (int i=0; i < 1000; ++i)
+  {
+    efd.signal ();
+  }
+  EXPECT_TRUE (efd.reset ());
+  EXPECT_FALSE (readable (efd.fd ()));
+}
+
+TEST(EventFd,CrossThread)
+{
+  cdn::thread::EventFd efd;
+
+  auto fut = std::async (std::launch::async,
+                         [&]
+                         {
+                           std::this_thread::sleep_for (std::chrono::milliseconds (20));
+                           efd.signal ();
+                         });
+
+  EXPECT_TRUE (readable (efd.fd (), 5000));
+  fut.get ();
+}
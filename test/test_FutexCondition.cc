@@ -0,0 +1,130 @@
+// test_FutexCondition.cc
+
+#include "FutexCondition.h"
+#include "DataGuard.h"
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+
+TEST(FutexCondition,DefaultConstructor)
+{
+  cdn::thread::FutexCondition cond;
+}
+
+TEST(FutexCondition,NotifyWithoutWaiters)
+{
+  cdn::thread::FutexCondition cond;
+  cond.notify_one ();
+  cond.notify_all ();
+}
+
+TEST(FutexCondition,PredicateAlreadyTrue)
+{
+  cdn::thread::FutexCondition cond;
+  std::mutex mtx;
+  std::unique_lock<std::mutex> lock (mtx);
+  cond.wait (lock, [] { return true; });
+  EXPECT_TRUE (cond.wait_for (lock, std::chrono::milliseconds (0), [] { return true; }));
+}
+
+TEST(FutexCondition,WaitForTimeout)
+{
+  cdn::thread::FutexCondition cond;
+  std::mutex mtx;
+  std::unique_lock<std::mutex> lock (mtx);
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_FALSE (cond.wait_for (lock, std::chrono::milliseconds (100), [] { return false; }));
+  EXPECT_GE (std::chrono::steady_clock::now () - start, std::chrono::milliseconds (100));
+  // the lock is held again on return
+  EXPECT_TRUE (lock.owns_lock ());
+}
+
+TEST(FutexCondition,NotifyOne)
+{
+  cdn::thread::FutexCondition cond;
+  std::mutex mtx;
+  bool ready = false;
+
+  auto fut = std::async (std::launch::async,
+                         [&]
+                         {
+                           std::unique_lock<std::mutex> lock (mtx);
+                           cond.wait (lock, [&] { return ready; });
+                         });
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+  {
+    std::lock_guard<std::mutex> lock (mtx);
+    ready = true;
+  }
+  cond.notify_one ();
+
+  EXPECT_EQ (std::future_status::ready, fut.wait_for (std::chrono::seconds (5)));
+}
+
+TEST(FutexCondition,NotifyAll)
+{
+  cdn::thread::FutexCondition cond;
+  std::mutex mtx;
+  bool ready = false;
+
+  std::vector<std::future<void>> futs;
+  for (int i=0; i < 4; ++i)
+  {
+    futs.push_back (std::async (std::launch::async,
+                                [&]
+                                {
+                                  std::unique_lock<std::mutex> lock (mtx);
+                                  cond.wait (lock, [&] { return ready; });
+                                }));
+  }
+
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+  {
+    std::lock_guard<std::mutex> lock (mtx);
+    ready = true;
+  }
+  cond.notify_all ();
+
+  for (auto& fut : futs)
+  {
+    EXPECT_EQ (std::future_status::ready, fut.wait_for (std::chrono::seconds (5)));
+  }
+}
+
+TEST(FutexCondition,DataGuardPingPong)
+{
+  // a lost wakeup would leave one side asleep and the test hanging
+  cdn::thread::FutexCondition cond;
+  cdn::thread::DataGuard<int> turn (0);
+  const int rounds = 10000;
+
+  auto fut = std::async (std::launch::async,
+                         [&]
+                         {
+                           for (int i=0; i < rounds; ++i)
+                           {
+                             auto lock (cdn::thread::lockDataGuard (turn));
+                             cond.wait (lock, [&] { return turn (lock) == 1; });
+                             turn (lock) = 0;
+                             cond.notify_one ();
+                           }
+                         });
+
+  for (int i=0; i < rounds; ++i)
+  {
+    auto lock (cdn::thread::lockDataGuard (turn));
+    cond.wait (lock, [&] { return turn (lock) == 0; });
+    turn (lock) = 1;
+    cond.notify_one ();
+  }
+
+  EXPECT_EQ (std::future_status::ready, fut.wait_for (std::chrono::seconds (30)));
+}
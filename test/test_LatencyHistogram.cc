@@ -0,0 +1,100 @@
+// test_LatencyHistogram.cc
+
+#include "LatencyHistogram.h"
+
+#include <cstdint>
+#include <limits>
+
+#include "gtest/gtest.h"
+
+TEST(LatencyHistogram,Empty)
+{
+  cdn::container::LatencyHistogram h;
+  EXPECT_EQ (h.count (), 0UL);
+  EXPECT_EQ (h.min (), 0UL);
+  EXPECT_EQ (h.max (), 0UL);
+  EXPECT_EQ (h.mean (), 0.0);
+  EXPECT_EQ (h.percentile (50.0), 0UL);
+}
+
+TEST(LatencyHistogram,SmallValuesAreExact)
+{
+  cdn::container::LatencyHistogram h;
+  for (std::uint64_t v=0; v < 64; ++v)
+  {
+    EXPECT_EQ (cdn::container::LatencyHistogram::bucketOf (v), v);
+    EXPECT_EQ (cdn::container::LatencyHistogram::bucketTop (v), v);
+    h.record (v);
+  }
+  EXPECT_EQ (h.count (), 64UL);
+  EXPECT_EQ (h.min (), 0UL);
+  EXPECT_EQ (h.max (), 63UL);
+  EXPECT_EQ (h.mean (), 31.5);
+  EXPECT_EQ (h.percentile (50.0), 31UL);
+  EXPECT_EQ (h.percentile (100.0), 63UL);
+}
+
+TEST(LatencyHistogram,BucketsCoverRange)
+{
+  const std::size_t last = (64 - 5 + 1) * 32 - 1;
+
+  std::uint64_t prevTop = 0;
+  for (std::size_t b=1; b <= last; ++b)
+  {
+    auto top = cdn::container::LatencyHistogram::bucketTop (b);
+    EXPECT_GT (top, prevTop);
+    // the bucket starts right after the previous one ends
+    EXPECT_EQ (cdn::container::LatencyHistogram::bucketOf (prevTop + 1), b);
+    EXPECT_EQ (cdn::container::LatencyHistogram::bucketOf (top), b);
+    prevTop = top;
+  }
+  EXPECT_EQ (prevTop, std::numeric_limits<std::uint64_t>::max ());
+}
+
+TEST(LatencyHistogram,RelativeError)
+{
+  for (std::uint64_t v=100; v < 100000000000ULL; v = v * 3 + 7)
+  {
+    auto top = cdn::container::LatencyHistogram::bucketTop (cdn::container::LatencyHistogram::bucketOf (v));
+    EXPECT_GE (top, v);
+    EXPECT_LE (static_cast<double> (top - v) / v, 1.0 / 32);
+  }
+}
+
+TEST(LatencyHistogram,Percentiles)
+{
+  cdn::container::LatencyHistogram h;
+  for (std::uint64_t v=1; v <= 1000; ++v)
+  {
+    h.record (v * 1000);
+  }
+
+  EXPECT_NEAR (h.percentile (50.0), 500000.0, 500000.0 / 32);
+  EXPECT_NEAR (h.percentile (99.0), 990000.0, 990000.0 / 32);
+  EXPECT_NEAR (h.percentile (99.9), 999000.0, 999000.0 / 32);
+  EXPECT_EQ (h.percentile (100.0), 1000000UL);
+  EXPECT_EQ (h.min (), 1000UL);
+  EXPECT_EQ (h.max (), 1000000UL);
+  EXPECT_DOUBLE_EQ (h.mean (), 500500.0);
+}
+
+TEST(LatencyHistogram,MergeAndReset)
+{
+  cdn::container::LatencyHistogram a;
+  cdn::container::LatencyHistogram b;
+  a.record (10);
+  a.record (20);
+  b.record (5);
+  b.record (5000);
+
+  a.merge (b);
+  EXPECT_EQ (a.count (), 4UL);
+  EXPECT_EQ (a.min (), 5UL);
+  EXPECT_EQ (a.max (), 5000UL);
+
+  a.reset ();
+  EXPECT_EQ (a.count (), 0UL);
+  EXPECT_EQ (a.max (), 0UL);
+  a.record (7);
+  EXPECT_EQ (a.min (), 7UL);
+}
@@ -0,0 +1,234 @@
+// test_MpmcQueue.cc
+
+#include "MpmcQueue.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+class ThrowOnNegative
+{
+public:
+  explicit ThrowOnNegative (int idx)
+    : m_idx (idx)
+  { 
+    if (idx < 0)
+    {
+      throw std::invalid_argument ("negative");
+    }
+  }
+
+  int
+  idx ()
+    const
+  { return m_idx; }
+
+private:
+  int m_idx;
+};
+
+} // namespace
+
+
+TEST(Int,Constructors)
+{
+  cdn::container::MpmcQueue<int, 5> fail (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::MpmcQueue<int, 5> block (cdn::container::CircularQueueMode::BlockOnWrite);
+  cdn::container::MpmcQueue<int, 5> nonBlock (cdn::container::CircularQueueMode::NonBlockingWrite);
+}
+
+TEST(Int,EmptySizeMax)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  EXPECT_TRUE (q.isEmpty ());
+  EXPECT_EQ (q.size (), 0UL);
+  EXPECT_EQ (q.max (), 5UL);
+  EXPECT_FALSE (q.isShutdown ());
+}
+
+TEST(Int,PushPopOrder)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  for (int i=0; i < 17; ++i)
+  {
+    q.push (i);
+    q.emplace (i + 100);
+    EXPECT_EQ (q.size (), 2UL);
+    EXPECT_EQ (q.pop (), i);
+    EXPECT_EQ (q.pop (), i + 100);
+  }
+  EXPECT_TRUE (q.isEmpty ());
+}
+
+TEST(Int,FailOnFull)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::FailOnWrite);
+  for (int i=0; i < 5; ++i)
+  {
+    q.push (i + 13);
+  }
+  EXPECT_THROW (q.push (99), cdn::container::CircularQueueError);
+  EXPECT_EQ (q.size (), 5UL);
+}
+
+TEST(Int,NonBlocking)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::NonBlockingWrite);
+  for (int i=0; i < 7; ++i)
+  {
+    q.push (i);
+  }
+  EXPECT_EQ (q.size (), 5UL);
+  // the two oldest elements were overwritten
+  for (int i=2; i < 7; ++i)
+  {
+    EXPECT_EQ (q.pop (), i);
+  }
+}
+
+TEST(Int,BlockOnWrite)
+{
+  cdn::container::MpmcQueue<int, 2> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  q.push (1);
+  q.push (2);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   EXPECT_EQ (q.pop (), 1);
+                 });
+
+  q.push (3);
+  t.join ();
+
+  EXPECT_EQ (q.pop (), 2);
+  EXPECT_EQ (q.pop (), 3);
+}
+
+TEST(Int,PopTimeout)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  boost::optional<int> v = q.pop (std::chrono::milliseconds (150));
+  EXPECT_TRUE (! v);
+
+  q.push (8);
+  v = q.pop (std::chrono::milliseconds (0));
+  ASSERT_FALSE (! v);
+  EXPECT_EQ (v.get (), 8);
+}
+
+TEST(Int,PopShutdown)
+{
+  cdn::container::MpmcQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   q.shutdown ();
+                 });
+
+  EXPECT_THROW (q.pop (), cdn::container::CircularQueueShutdown);
+  t.join ();
+
+  EXPECT_THROW (q.pop (std::chrono::milliseconds (10)), cdn::container::CircularQueueShutdown);
+}
+
+TEST(Int,ManyProducersManyConsumers)
+{
+  const int producers = 4;
+  const int consumers = 4;
+  const int perProducer = 25000;
+
+  cdn::container::MpmcQueue<int, 64> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  std::atomic<long long> sum (0);
+  std::atomic<int>       popped (0);
+
+  std::vector<std::thread> threads;
+  for (int p=0; p < producers; ++p)
+  {
+    threads.emplace_back ([&, p]
+                          {
+                            for (int i=0; i < perProducer; ++i)
+                            {
+                              q.push (p * perProducer + i);
+                            }
+                          });
+  }
+  for (int c=0; c < consumers; ++c)
+  {
+    threads.emplace_back ([&]
+                          {
+                            try
+                            {
+                              for (;;)
+                              {
+                                sum += q.pop ();
+                                ++popped;
+                              }
+                            }
+                            catch (const cdn::container::CircularQueueShutdown&)
+                            { }
+                          });
+  }
+
+  for (int p=0; p < producers; ++p)
+  {
+    threads[p].join ();
+  }
+  while (popped.load () < producers * perProducer)
+  {
+    std::this_thread::yield ();
+  }
+  q.shutdown ();
+  for (int c=0; c < consumers; ++c)
+  {
+    threads[producers + c].join ();
+  }
+
+  const long long total = producers * perProducer;
+  EXPECT_EQ (sum.load (), total * (total - 1) / 2);
+}
+
+TEST(UniquePtr,MoveOnly)
+{
+  cdn::container::MpmcQueue<std::unique_ptr<int>, 3> q (cdn::container::CircularQueueMode::FailOnWrite);
+  q.emplace (new int (5));
+  q.emplace (std::unique_ptr<int> (new int (6)));
+  EXPECT_EQ (*q.pop (), 5);
+  boost::optional<std::unique_ptr<int>> v = q.pop (std::chrono::milliseconds (0));
+  ASSERT_FALSE (! v);
+  EXPECT_EQ (**v, 6);
+}
+
+TEST(SharedPtr,DestroyUnpopped)
+{
+  auto p = std::make_shared<int> (3);
+  {
+    cdn::container::MpmcQueue<std::shared_ptr<int>, 4> q (cdn::container::CircularQueueMode::NonBlockingWrite);
+    for (int i=0; i < 6; ++i)
+    {
+      q.push (p);
+    }
+    EXPECT_EQ (p.use_count (), 5);
+  }
+  EXPECT_EQ (p.use_count (), 1);
+}
+
+TEST(Throwing,ConstructorThrowLeavesHole)
+{
+  cdn::container::MpmcQueue<ThrowOnNegative, 4> q (cdn::container::CircularQueueMode::FailOnWrite);
+  q.emplace (1);
+  EXPECT_THROW (q.emplace (-1), cdn::container::CircularQueueError);
+  q.emplace (2);
+  EXPECT_EQ (q.pop ().idx (), 1);
+  EXPECT_EQ (q.pop ().idx (), 2);
+  EXPECT_TRUE (q.isEmpty ());
+}
@@ -0,0 +1,275 @@
+// test_PriorityCircularQueue.cc
+
+#include "PriorityCircularQueue.h"
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+typedef cdn::container::PriorityCircularQueue<int, 3> ThreeLanes;
+
+std::array<cdn::container::PriorityLane, 3>
+threeLanes (cdn::container::CircularQueueMode mode,
+            std::size_t capacity = 8)
+{
+  return {{ cdn::container::PriorityLane (mode, cdn::container::CircularQueueCapacity (capacity)),
+            cdn::container::PriorityLane (mode, cdn::container::CircularQueueCapacity (capacity)),
+            cdn::container::PriorityLane (mode, cdn::container::CircularQueueCapacity (capacity)) }};
+}
+
+} // namespace
+
+TEST(PriorityCircularQueue,Construct)
+{
+  std::array<cdn::container::PriorityLane, 2> lanes =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (4)),
+       cdn::container::PriorityLane (cdn::container::CircularQueueMode::BlockOnWrite,
+                                     cdn::container::CircularQueueCapacity (1000)) }};
+  cdn::container::PriorityCircularQueue<int, 2> pq (lanes);
+
+  EXPECT_TRUE (pq.isEmpty ());
+  EXPECT_EQ (pq.size (), 0U);
+  EXPECT_EQ (pq.max (0), 4U);
+  EXPECT_EQ (pq.max (1), 1000U);
+  EXPECT_THROW (pq.max (2), cdn::container::CircularQueueError);
+  EXPECT_THROW (pq.size (2), cdn::container::CircularQueueError);
+}
+
+TEST(PriorityCircularQueue,BadConfig)
+{
+  std::array<cdn::container::PriorityLane, 1> empty =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (0)) }};
+  EXPECT_THROW ((cdn::container::PriorityCircularQueue<int, 1> (empty)), cdn::container::CircularQueueError);
+
+  std::array<cdn::container::PriorityLane, 1> weightless =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (4),
+                                     0) }};
+  EXPECT_THROW ((cdn::container::PriorityCircularQueue<int, 1> (weightless)), cdn::container::CircularQueueError);
+}
+
+TEST(PriorityCircularQueue,HighestLaneFirst)
+{
+  ThreeLanes pq (threeLanes (cdn::container::CircularQueueMode::FailOnWrite));
+
+  pq.push (2, 20);
+  pq.push (2, 21);
+  pq.push (1, 10);
+  pq.push (0, 0);
+  pq.emplace (1, 11);
+  EXPECT_EQ (pq.size (), 5U);
+  EXPECT_EQ (pq.size (1), 2U);
+
+  EXPECT_EQ (pq.pop (), 0);
+  EXPECT_EQ (pq.pop (), 10);
+  EXPECT_EQ (pq.pop (), 11);
+  EXPECT_EQ (pq.pop (), 20);
+
+  // a later high priority push goes ahead of what is left
+  pq.push (0, 1);
+  EXPECT_EQ (pq.pop (), 1);
+  EXPECT_EQ (pq.pop (), 21);
+  EXPECT_TRUE (pq.isEmpty ());
+}
+
+TEST(PriorityCircularQueue,TryPop)
+{
+  ThreeLanes pq (threeLanes (cdn::container::CircularQueueMode::FailOnWrite));
+
+  int v = 0;
+  std::size_t lane = 99;
+  EXPECT_FALSE (pq.tryPop (v, lane));
+  EXPECT_EQ (lane, 99U);
+
+  pq.push (2, 5);
+  EXPECT_TRUE (pq.tryPop (v, lane));
+  EXPECT_EQ (v, 5);
+  EXPECT_EQ (lane, 2U);
+}
+
+TEST(PriorityCircularQueue,TimedPop)
+{
+  ThreeLanes pq (threeLanes (cdn::container::CircularQueueMode::FailOnWrite));
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_FALSE (pq.pop (std::chrono::milliseconds (50)));
+  EXPECT_GE (std::chrono::steady_clock::now () - start, std::chrono::milliseconds (50));
+
+  pq.push (1, 3);
+  auto v = pq.pop (std::chrono::milliseconds (50));
+  ASSERT_TRUE (static_cast<bool> (v));
+  EXPECT_EQ (v.get (), 3);
+}
+
+TEST(PriorityCircularQueue,LaneModes)
+{
+  std::array<cdn::container::PriorityLane, 2> lanes =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (2)),
+       cdn::container::PriorityLane (cdn::container::CircularQueueMode::NonBlockingWrite,
+                                     cdn::container::CircularQueueCapacity (2)) }};
+  cdn::container::PriorityCircularQueue<int, 2> pq (lanes);
+
+  pq.push (0, 1);
+  pq.push (0, 2);
+  EXPECT_THROW (pq.push (0, 3), cdn::container::CircularQueueError);
+  EXPECT_THROW (pq.push (2, 3), cdn::container::CircularQueueError);
+
+  // the full lane does not stop the other one, which overwrites
+  pq.push (1, 10);
+  pq.push (1, 11);
+  pq.push (1, 12);
+  EXPECT_EQ (pq.size (1), 2U);
+
+  EXPECT_EQ (pq.pop (), 1);
+  EXPECT_EQ (pq.pop (), 2);
+  EXPECT_EQ (pq.pop (), 11);
+  EXPECT_EQ (pq.pop (), 12);
+}
+
+TEST(PriorityCircularQueue,BlockOnWrite)
+{
+  ThreeLanes pq (threeLanes (cdn::container::CircularQueueMode::BlockOnWrite, 1));
+
+  pq.push (2, 1);
+  std::thread producer ([&] { pq.push (2, 2); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+
+  // only lane 2 is full
+  pq.push (0, 0);
+
+  EXPECT_EQ (pq.pop (), 0);
+  EXPECT_EQ (pq.pop (), 1);
+  producer.join ();
+  EXPECT_EQ (pq.pop (), 2);
+}
+
+TEST(PriorityCircularQueue,MoveOnly)
+{
+  std::array<cdn::container::PriorityLane, 2> lanes =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (2)),
+       cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (2)) }};
+  cdn::container::PriorityCircularQueue<std::unique_ptr<std::string>, 2> pq (lanes);
+
+  pq.push (1, std::unique_ptr<std::string> (new std::string ("bulk")));
+  pq.emplace (0, new std::string ("control"));
+
+  EXPECT_EQ (*pq.pop (), "control");
+  EXPECT_EQ (*pq.pop (), "bulk");
+}
+
+TEST(PriorityCircularQueue,WeightedService)
+{
+  std::array<cdn::container::PriorityLane, 2> lanes =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (64),
+                                     3),
+       cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (64),
+                                     1) }};
+  cdn::container::PriorityCircularQueue<int, 2> pq (lanes, cdn::container::PriorityService::Weighted);
+
+  for (int i=0; i < 8; ++i)
+  {
+    pq.push (0, i);
+    pq.push (1, 100 + i);
+  }
+
+  // three from the high lane for every one from the low lane
+  std::vector<int> order;
+  for (int i=0; i < 8; ++i)
+  {
+    order.push_back (pq.pop ());
+  }
+  std::vector<int> expected = { 0, 1, 2, 100, 3, 4, 5, 101 };
+  EXPECT_EQ (order, expected);
+}
+
+TEST(PriorityCircularQueue,WeightedEmptyLaneGivesUpShare)
+{
+  std::array<cdn::container::PriorityLane, 2> lanes =
+    {{ cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (64),
+                                     1),
+       cdn::container::PriorityLane (cdn::container::CircularQueueMode::FailOnWrite,
+                                     cdn::container::CircularQueueCapacity (64),
+                                     1) }};
+  cdn::container::PriorityCircularQueue<int, 2> pq (lanes, cdn::container::PriorityService::Weighted);
+
+  for (int i=0; i < 4; ++i)
+  {
+    pq.push (1, i);
+  }
+  for (int i=0; i < 4; ++i)
+  {
+    EXPECT_EQ (pq.pop (), i);
+  }
+}
+
+TEST(PriorityCircularQueue,Shutdown)
+{
+  ThreeLanes full (threeLanes (cdn::container::CircularQueueMode::BlockOnWrite, 1));
+  full.push (2, 1);
+  ThreeLanes empty (threeLanes (cdn::container::CircularQueueMode::BlockOnWrite, 1));
+
+  std::thread producer ([&] { EXPECT_THROW (full.push (2, 2), cdn::container::CircularQueueShutdown); });
+  std::thread consumer ([&] { EXPECT_THROW (empty.pop (), cdn::container::CircularQueueShutdown); });
+  std::this_thread::sleep_for (std::chrono::milliseconds (100));
+
+  full.shutdown ();
+  empty.shutdown ();
+  producer.join ();
+  consumer.join ();
+  EXPECT_TRUE (full.isShutdown ());
+
+  int v = 0;
+  std::size_t lane = 0;
+  EXPECT_THROW (empty.tryPop (v, lane), cdn::container::CircularQueueShutdown);
+}
+
+TEST(PriorityCircularQueue,OneWaiterAllLanes)
+{
+  const int count = 10000;
+  const int laneStride = 1000000;
+  ThreeLanes pq (threeLanes (cdn::container::CircularQueueMode::BlockOnWrite, 16));
+
+  std::vector<std::thread> producers;
+  for (std::size_t lane=0; lane < 3; ++lane)
+  {
+    producers.emplace_back ([&, lane]
+                            {
+                              for (int i=0; i < count; ++i)
+                              {
+                                pq.push (lane, static_cast<int> (lane) * laneStride + i);
+                              }
+                            });
+  }
+
+  // one consumer, woken by whichever lane is pushed, FIFO within every lane
+  std::vector<int> next (3, 0);
+  for (int i=0; i < 3 * count; ++i)
+  {
+    auto v = pq.pop (std::chrono::seconds (5));
+    ASSERT_TRUE (static_cast<bool> (v));
+    auto lane = v.get () / laneStride;
+    EXPECT_EQ (v.get () % laneStride, next[lane]++);
+  }
+  EXPECT_TRUE (pq.isEmpty ());
+
+  for (auto& t : producers)
+  {
+    t.join ();
+  }
+}
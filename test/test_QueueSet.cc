@@ -0,0 +1,275 @@
+// test_QueueSet.cc
+
+#include "CircularQueue.h"
+
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+typedef cdn::container::CircularQueue<int, 16> IntQueue;
+
+} // namespace
+
+TEST(QueueSet,Empty)
+{
+  cdn::container::QueueSet set;
+  EXPECT_EQ (set.size (), 0U);
+  EXPECT_FALSE (set.select (std::chrono::milliseconds (20)));
+}
+
+TEST(QueueSet,AddRemove)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue b (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set;
+
+  EXPECT_EQ (set.add (a), 0U);
+  EXPECT_EQ (set.add (b), 1U);
+  EXPECT_EQ (set.size (), 2U);
+
+  set.remove (0);
+  EXPECT_EQ (set.size (), 1U);
+  EXPECT_THROW (set.remove (0), cdn::container::CircularQueueError);
+  EXPECT_THROW (set.remove (64), cdn::container::CircularQueueError);
+  // 65 would alias the bit of queue 1 if the shift ran before the check
+  EXPECT_THROW (set.remove (65), cdn::container::CircularQueueError);
+
+  // the lowest free number is reused
+  EXPECT_EQ (set.add (a), 0U);
+}
+
+TEST(QueueSet,OneSetPerQueue)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set;
+  cdn::container::QueueSet other;
+
+  set.add (a);
+  EXPECT_THROW (set.add (a), cdn::container::CircularQueueError);
+  EXPECT_THROW (other.add (a), cdn::container::CircularQueueError);
+
+  set.remove (0);
+  EXPECT_EQ (other.add (a), 0U);
+}
+
+TEST(QueueSet,Full)
+{
+  std::vector<std::unique_ptr<IntQueue>> queues;
+  cdn::container::QueueSet set;
+  for (std::size_t i=0; i < cdn::container::QueueSet::MaxQueues; ++i)
+  {
+    queues.emplace_back (new IntQueue (cdn::container::CircularQueueMode::FailOnWrite));
+    EXPECT_EQ (set.add (*queues.back ()), i);
+  }
+
+  IntQueue extra (cdn::container::CircularQueueMode::FailOnWrite);
+  EXPECT_THROW (set.add (extra), cdn::container::CircularQueueError);
+
+  queues[63]->push (63);
+  EXPECT_EQ (set.select (), 63U);
+}
+
+TEST(QueueSet,SelectReady)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::CircularQueue<std::string, 16> b (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set;
+  set.add (a);
+  set.add (b);
+
+  b.push ("one");
+  b.push ("two");
+  EXPECT_EQ (set.select (), 1U);
+
+  // still ready while it holds elements
+  std::string s;
+  EXPECT_EQ (b.tryPop (s), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (set.select (), 1U);
+  EXPECT_EQ (b.tryPop (s), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_FALSE (set.select (std::chrono::milliseconds (10)));
+
+  a.push (1);
+  EXPECT_EQ (set.select (), 0U);
+}
+
+TEST(QueueSet,ReadyWhenAdded)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  a.push (1);
+
+  cdn::container::QueueSet set;
+  set.add (a);
+  EXPECT_EQ (set.select (), 0U);
+}
+
+TEST(QueueSet,Priority)
+{
+  IntQueue high (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue low (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set (cdn::container::QueueSetOrder::Priority);
+  set.add (high);
+  set.add (low);
+
+  low.push (1);
+  high.push (1);
+  high.push (2);
+
+  int v = 0;
+  EXPECT_EQ (set.select (), 0U);
+  EXPECT_EQ (high.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (set.select (), 0U);
+  EXPECT_EQ (high.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  EXPECT_EQ (set.select (), 1U);
+}
+
+TEST(QueueSet,RoundRobin)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue b (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue c (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set (cdn::container::QueueSetOrder::RoundRobin);
+  set.add (a);
+  set.add (b);
+  set.add (c);
+
+  for (int i=0; i < 4; ++i)
+  {
+    a.push (i);
+    c.push (i);
+  }
+
+  // a busy queue does not starve the others
+  EXPECT_EQ (set.select (), 0U);
+  EXPECT_EQ (set.select (), 2U);
+  EXPECT_EQ (set.select (), 0U);
+  EXPECT_EQ (set.select (), 2U);
+}
+
+TEST(QueueSet,Shutdown)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue b (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set;
+  set.add (a);
+  set.add (b);
+
+  b.push (1);
+  b.shutdown ();
+  // reported while it holds elements
+  EXPECT_EQ (set.select (), 1U);
+  int v = 0;
+  EXPECT_EQ (b.tryPop (v), cdn::container::CircularQueueStatus::Ok);
+  // and once more for the shutdown itself
+  EXPECT_EQ (set.select (), 1U);
+  EXPECT_EQ (b.tryPop (v), cdn::container::CircularQueueStatus::Shutdown);
+  EXPECT_FALSE (set.select (std::chrono::milliseconds (10)));
+
+  set.remove (1);
+  EXPECT_FALSE (set.select (std::chrono::milliseconds (10)));
+}
+
+TEST(QueueSet,ShutdownDoesNotStarve)
+{
+  IntQueue high (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue low (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set (cdn::container::QueueSetOrder::Priority);
+  set.add (high);
+  set.add (low);
+
+  high.shutdown ();
+  low.push (1);
+  EXPECT_EQ (set.select (), 0U);
+  EXPECT_EQ (set.select (), 1U);
+  EXPECT_EQ (set.select (), 1U);
+}
+
+TEST(QueueSet,QueueDestroyedFirst)
+{
+  cdn::container::QueueSet set;
+  {
+    IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+    set.add (a);
+    a.push (1);
+  }
+  // the queue took itself out of the set
+  EXPECT_EQ (set.size (), 0U);
+  EXPECT_FALSE (set.select (std::chrono::milliseconds (10)));
+
+  IntQueue b (cdn::container::CircularQueueMode::FailOnWrite);
+  EXPECT_EQ (set.add (b), 0U);
+}
+
+TEST(QueueSet,WakesSelector)
+{
+  IntQueue a (cdn::container::CircularQueueMode::FailOnWrite);
+  IntQueue b (cdn::container::CircularQueueMode::FailOnWrite);
+  cdn::container::QueueSet set;
+  set.add (a);
+  set.add (b);
+
+  std::thread producer ([&]
+                        {
+                          std::this_thread::sleep_for (std::chrono::milliseconds (50));
+                          b.push (7);
+                        });
+  EXPECT_EQ (set.select (), 1U);
+  producer.join ();
+}
+
+TEST(QueueSet,ManyProducers)
+{
+  const std::size_t queues = 4;
+  const int count = 20000;
+
+  std::vector<std::unique_ptr<cdn::container::CircularQueue<int>>> cqs;
+  cdn::container::QueueSet set;
+  for (std::size_t q=0; q < queues; ++q)
+  {
+    cqs.emplace_back (new cdn::container::CircularQueue<int> (cdn::container::CircularQueueMode::BlockOnWrite,
+                                                              cdn::container::CircularQueueCapacity (64)));
+    set.add (*cqs.back ());
+  }
+
+  std::vector<std::thread> producers;
+  for (std::size_t q=0; q < queues; ++q)
+  {
+    producers.emplace_back ([&, q]
+                            {
+                              for (int i=0; i < count; ++i)
+                              {
+                                cqs[q]->push (i);
+                              }
+                            });
+  }
+
+  // every queue is FIFO on its own
+  std::vector<int> next (queues, 0);
+  std::size_t total = 0;
+  std::vector<int> batch;
+  while (total < queues * count)
+  {
+    auto ready = set.select (std::chrono::seconds (5));
+    ASSERT_TRUE (static_cast<bool> (ready));
+
+    batch.clear ();
+    cqs[ready.get ()]->popAll (std::back_inserter (batch));
+    for (auto v : batch)
+    {
+      EXPECT_EQ (v, next[ready.get ()]++);
+    }
+    total += batch.size ();
+  }
+
+  for (auto& t : producers)
+  {
+    t.join ();
+  }
+}
@@ -0,0 +1,308 @@
+// test_ShmCircularQueue.cc
+
+#include "ShmCircularQueue.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+using cdn::container::CircularQueueError;
+using cdn::container::CircularQueueMode;
+using cdn::container::CircularQueueShutdown;
+using cdn::container::ShmCircularQueue;
+using cdn::container::ShmQueueRole;
+
+struct Tick
+{
+  int    seq;
+  double price;
+};
+
+// A name no other test run uses, removed again at the end of the test
+class ShmName
+{
+public:
+  ShmName ()
+    : m_name ("/cdn_test_" + std::to_string (::getpid ()) + "_" + std::to_string (s_next++))
+  {
+    ShmCircularQueue<int>::unlink (m_name);
+  }
+
+  ~ShmName ()
+  {
+    ShmCircularQueue<int>::unlink (m_name);
+  }
+
+  operator const std::string& ()
+    const
+  { return m_name; }
+
+private:
+  static int  s_next;
+  std::string m_name;
+};
+
+int ShmName::s_next = 0;
+
+// Wait for a forked child and return its exit code, -1 if it did not exit
+int
+reap (pid_t child)
+{
+  int status = 0;
+  ::waitpid (child, &status, 0);
+  return WIFEXITED (status) ? WEXITSTATUS (status) : -1;
+}
+
+} // namespace
+
+
+TEST(ShmCircularQueue,PushPop)
+{
+  ShmName name;
+  ShmCircularQueue<Tick> producer (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 4);
+  ShmCircularQueue<Tick> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::FailOnWrite, 4);
+
+  EXPECT_TRUE (consumer.isEmpty ());
+  EXPECT_EQ (4u, consumer.max ());
+  EXPECT_TRUE (producer.isPeerAttached ());
+  EXPECT_FALSE (producer.peerCrashed ());
+
+  for (int i=0; i < 10; ++i)
+  {
+    producer.push (Tick { i, i * 0.5 });
+    producer.emplace (Tick { i + 100, 0.0 });
+    EXPECT_EQ (2u, consumer.size ());
+
+    auto first = consumer.pop ();
+    EXPECT_EQ (i, first.seq);
+    EXPECT_EQ (i * 0.5, first.price);
+    EXPECT_EQ (i + 100, consumer.pop ().seq);
+  }
+  EXPECT_TRUE (producer.isEmpty ());
+}
+
+TEST(ShmCircularQueue,Unsupported)
+{
+  ShmName name;
+  EXPECT_THROW ((ShmCircularQueue<int> (name, ShmQueueRole::Producer, CircularQueueMode::NonBlockingWrite, 4)),
+                CircularQueueError);
+  EXPECT_THROW ((ShmCircularQueue<int> (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 0)),
+                CircularQueueError);
+}
+
+TEST(ShmCircularQueue,LayoutMismatch)
+{
+  ShmName name;
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 8);
+
+  EXPECT_THROW ((ShmCircularQueue<int> (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 16)),
+                CircularQueueError);
+  EXPECT_THROW ((ShmCircularQueue<int> (name, ShmQueueRole::Consumer, CircularQueueMode::FailOnWrite, 8)),
+                CircularQueueError);
+  EXPECT_THROW ((ShmCircularQueue<Tick> (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 8)),
+                CircularQueueError);
+
+  // the failed attaches did not take the role
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 8);
+  EXPECT_FALSE (consumer.peerCrashed ());
+}
+
+TEST(ShmCircularQueue,RoleHeld)
+{
+  ShmName name;
+  {
+    ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 4);
+    EXPECT_THROW ((ShmCircularQueue<int> (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 4)),
+                  CircularQueueError);
+  }
+
+  // released by the destructor
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 4);
+  EXPECT_FALSE (producer.isPeerAttached ());
+}
+
+TEST(ShmCircularQueue,WrongRole)
+{
+  ShmName name;
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 4);
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::FailOnWrite, 4);
+
+  EXPECT_THROW (consumer.push (1), CircularQueueError);
+  EXPECT_THROW (producer.pop (std::chrono::milliseconds (1)), CircularQueueError);
+}
+
+TEST(ShmCircularQueue,FailOnWrite)
+{
+  ShmName name;
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::FailOnWrite, 2);
+
+  producer.push (1);
+  producer.push (2);
+  EXPECT_THROW (producer.push (3), CircularQueueError);
+  EXPECT_EQ (2u, producer.size ());
+}
+
+TEST(ShmCircularQueue,TimedPop)
+{
+  ShmName name;
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 2);
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_FALSE (consumer.pop (std::chrono::milliseconds (20)));
+  EXPECT_GE (std::chrono::steady_clock::now () - start, std::chrono::milliseconds (20));
+}
+
+TEST(ShmCircularQueue,ShutdownReleasesWaiters)
+{
+  ShmName name;
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 1);
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 1);
+
+  std::thread waiter ([&]
+                      {
+                        EXPECT_THROW (consumer.pop (), CircularQueueShutdown);
+                      });
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+  producer.shutdown ();
+  waiter.join ();
+
+  EXPECT_TRUE (consumer.isShutdown ());
+}
+
+TEST(ShmCircularQueue,AcrossProcesses)
+{
+  ShmName name;
+  const int count = 20000;
+
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 16);
+
+  pid_t child = ::fork ();
+  ASSERT_NE (-1, child);
+  if (child == 0)
+  {
+    try
+    {
+      ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 16);
+      for (int i=0; i < count; ++i)
+      {
+        producer.push (i);
+      }
+    }
+    catch (...)
+    {
+      ::_exit (1);
+    }
+    ::_exit (0);
+  }
+
+  int expected = 0;
+  while (expected < count)
+  {
+    auto val = consumer.pop (std::chrono::seconds (10));
+    ASSERT_TRUE (val);
+    ASSERT_EQ (expected, *val);
+    ++expected;
+  }
+  EXPECT_EQ (0, reap (child));
+}
+
+TEST(ShmCircularQueue,CrashedPeer)
+{
+  ShmName name;
+
+  // The child pushes and dies without detaching
+  pid_t child = ::fork ();
+  ASSERT_NE (-1, child);
+  if (child == 0)
+  {
+    try
+    {
+      ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 8);
+      producer.push (1);
+      producer.push (2);
+      producer.push (3);
+      ::_exit (0);
+    }
+    catch (...)
+    {
+      ::_exit (1);
+    }
+  }
+  ASSERT_EQ (0, reap (child));
+
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 8);
+  EXPECT_TRUE (consumer.peerCrashed ());
+  EXPECT_FALSE (consumer.isPeerAttached ());
+  EXPECT_EQ (3u, consumer.size ());
+
+  // A new producer takes the role over and the elements are kept
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 8);
+  EXPECT_TRUE (consumer.isPeerAttached ());
+  producer.push (4);
+
+  for (int i=1; i <= 4; ++i)
+  {
+    EXPECT_EQ (i, consumer.pop ());
+  }
+}
+
+TEST(ShmCircularQueue,RestartAfterShutdown)
+{
+  ShmName name;
+  {
+    ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 4);
+    ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 4);
+    producer.push (1);
+    producer.shutdown ();
+    EXPECT_EQ (1, consumer.pop ());
+    EXPECT_THROW (consumer.pop (), CircularQueueShutdown);
+  }
+
+  // Both processes went away, the restarted ones start a new session
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 4);
+  EXPECT_FALSE (consumer.isShutdown ());
+  ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 4);
+  producer.push (2);
+  EXPECT_EQ (2, consumer.pop ());
+}
+
+TEST(ShmCircularQueue,PeerDiesWhileWaiting)
+{
+  ShmName name;
+  ShmCircularQueue<int> consumer (name, ShmQueueRole::Consumer, CircularQueueMode::BlockOnWrite, 4);
+
+  // The child attaches and dies without detaching or pushing
+  pid_t child = ::fork ();
+  ASSERT_NE (-1, child);
+  if (child == 0)
+  {
+    try
+    {
+      ShmCircularQueue<int> producer (name, ShmQueueRole::Producer, CircularQueueMode::BlockOnWrite, 4);
+      std::this_thread::sleep_for (std::chrono::milliseconds (50));
+      ::_exit (0);
+    }
+    catch (...)
+    {
+      ::_exit (1);
+    }
+  }
+
+  // A zombie still looks alive, so reap it while the pop waits
+  int status = -1;
+  std::thread reaper ([&] { status = reap (child); });
+
+  auto start = std::chrono::steady_clock::now ();
+  EXPECT_THROW (consumer.pop (), CircularQueueError);
+  EXPECT_LT (std::chrono::steady_clock::now () - start, std::chrono::seconds (5));
+  reaper.join ();
+  EXPECT_EQ (0, status);
+}
@@ -0,0 +1,250 @@
+// test_SpscQueue.cc
+
+#include "SpscQueue.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+class NoDefault
+{
+public:
+  explicit NoDefault (int idx)
+    : m_idx (idx)
+  { }
+
+  int
+  idx ()
+    const
+  { return m_idx; }
+
+private:
+  int m_idx;
+};
+
+} // namespace
+
+
+TEST(Int,FailModeConstructor)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::FailOnWrite);
+}
+
+TEST(Int,BlockModeConstructor)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+}
+
+TEST(Int,NonBlockingModeConstructor)
+{
+  typedef cdn::container::SpscQueue<int, 5> Queue;
+  EXPECT_THROW (Queue q (cdn::container::CircularQueueMode::NonBlockingWrite), 
+                cdn::container::CircularQueueError);
+}
+
+TEST(Int,EmptySizeMax)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  EXPECT_TRUE (q.isEmpty ());
+  EXPECT_EQ (q.size (), 0UL);
+  EXPECT_EQ (q.max (), 5UL);
+  EXPECT_FALSE (q.isShutdown ());
+}
+
+TEST(Int,PushPopOrder)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  q.push (42);
+  q.emplace (24);
+  EXPECT_EQ (q.size (), 2UL);
+  EXPECT_EQ (q.pop (), 42);
+  EXPECT_EQ (q.pop (), 24);
+  EXPECT_TRUE (q.isEmpty ());
+}
+
+TEST(Int,Wraparound)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  for (int i=0; i < 23; ++i)
+  {
+    q.push (i);
+    q.push (i + 100);
+    EXPECT_EQ (q.pop (), i);
+    EXPECT_EQ (q.pop (), i + 100);
+  }
+  EXPECT_EQ (q.size (), 0UL);
+}
+
+TEST(Int,FailOnFull)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::FailOnWrite);
+  for (int i=0; i < 5; ++i)
+  {
+    q.push (i + 13);
+  }
+  EXPECT_EQ (q.size (), 5UL);
+  EXPECT_THROW (q.push (99), cdn::container::CircularQueueError);
+  EXPECT_EQ (q.pop (), 13);
+}
+
+TEST(Int,BlockOnWrite)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  for (int i=0; i < 5; ++i)
+  {
+    q.push (i + 98);
+  }
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   EXPECT_EQ (q.pop (), 98);
+                 });
+
+  // waits for the consumer to make room
+  q.push (224);
+  t.join ();
+
+  EXPECT_EQ (q.size (), 5UL);
+}
+
+TEST(Int,BlockOnWriteShutdown)
+{
+  cdn::container::SpscQueue<int, 1> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  q.push (1);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   q.shutdown ();
+                 });
+
+  EXPECT_THROW (q.push (2), cdn::container::CircularQueueShutdown);
+  t.join ();
+}
+
+TEST(Int,BlockOnWriteShutdownWithRoom)
+{
+  cdn::container::SpscQueue<int, 1> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  q.push (1);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   q.shutdown ();
+                   EXPECT_EQ (q.pop (), 1);
+                 });
+
+  // room appears after the shutdown, the push must still fail
+  EXPECT_THROW (q.push (2), cdn::container::CircularQueueShutdown);
+  t.join ();
+  EXPECT_EQ (q.size (), 0UL);
+}
+
+TEST(Int,PopTimeout)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  boost::optional<int> v = q.pop (std::chrono::milliseconds (150));
+  EXPECT_TRUE (! v);
+}
+
+TEST(Int,BlockedRead)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   q.push (1118);
+                 });
+
+  boost::optional<int> v = q.pop (std::chrono::seconds (3));
+  ASSERT_FALSE (! v);
+  EXPECT_EQ (v.get (), 1118);
+
+  t.join ();
+}
+
+TEST(Int,PopShutdown)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread t ([&] 
+                 {
+                   std::this_thread::sleep_for (std::chrono::milliseconds (250));
+                   q.shutdown ();
+                 });
+
+  EXPECT_THROW (q.pop (), cdn::container::CircularQueueShutdown);
+  t.join ();
+}
+
+TEST(Int,DrainAfterShutdown)
+{
+  cdn::container::SpscQueue<int, 5> q (cdn::container::CircularQueueMode::BlockOnWrite);
+  q.push (7);
+  q.shutdown ();
+  EXPECT_EQ (q.pop (), 7);
+  EXPECT_THROW (q.pop (), cdn::container::CircularQueueShutdown);
+}
+
+TEST(Int,ProducerConsumer)
+{
+  const int count = 200000;
+  cdn::container::SpscQueue<int, 64> q (cdn::container::CircularQueueMode::BlockOnWrite);
+
+  std::thread producer ([&] 
+                        {
+                          for (int i=0; i < count; ++i)
+                          {
+                            q.push (i);
+                          }
+                        });
+
+  for (int i=0; i < count; ++i)
+  {
+    ASSERT_EQ (q.pop (), i);
+  }
+
+  producer.join ();
+  EXPECT_TRUE (q.isEmpty ());
+}
+
+TEST(UniquePtr,MoveOnly)
+{
+  cdn::container::SpscQueue<std::unique_ptr<int>, 3> q (cdn::container::CircularQueueMode::FailOnWrite);
+  q.emplace (new int (5));
+  q.emplace (std::unique_ptr<int> (new int (6)));
+  std::unique_ptr<int> v = q.pop ();
+  EXPECT_EQ (*v, 5);
+  EXPECT_EQ (*q.pop (), 6);
+}
+
+TEST(SharedPtr,DestroyUnpopped)
+{
+  auto p = std::make_shared<int> (3);
+  {
+    cdn::container::SpscQueue<std::shared_ptr<int>, 4> q (cdn::container::CircularQueueMode::FailOnWrite);
+    q.push (p);
+    q.push (p);
+    EXPECT_EQ (p.use_count (), 3);
+    q.pop ();
+    EXPECT_EQ (p.use_count (), 2);
+  }
+  EXPECT_EQ (p.use_count (), 1);
+}
+
+TEST(NoDefault,PushPop)
+{
+  cdn::container::SpscQueue<NoDefault, 2> q (cdn::container::CircularQueueMode::FailOnWrite);
+  q.emplace (41);
+  q.push (NoDefault (42));
+  EXPECT_EQ (q.pop ().idx (), 41);
+  EXPECT_EQ (q.pop ().idx (), 42);
+}
@@ -0,0 +1,330 @@
+// test_ThreadPool.cc
+
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+using cdn::thread::ThreadPool;
+using cdn::thread::ThreadPoolError;
+using cdn::thread::ThreadPoolShutdown;
+
+// Split [0, count) in halves until the pieces are small, from inside the pool
+void
+split (ThreadPool& pool, std::atomic<int>& done, int count)
+{
+  if (count <= 4)
+  {
+    done += count;
+    return;
+  }
+  pool.submit ([&pool, &done, count] { split (pool, done, count / 2); });
+  pool.submit ([&pool, &done, count] { split (pool, done, count - count / 2); });
+}
+
+void
+waitFor (const std::atomic<int>& value, int expected)
+{
+  auto deadline = std::chrono::steady_clock::now () + std::chrono::seconds (30);
+  while (value.load () < expected && std::chrono::steady_clock::now () < deadline)
+  {
+    std::this_thread::sleep_for (std::chrono::milliseconds (1));
+  }
+}
+
+} // namespace
+
+
+TEST(ThreadPool,Construct)
+{
+  ThreadPool pool (3);
+  EXPECT_EQ (3u, pool.size ());
+  EXPECT_FALSE (pool.isShutdown ());
+  EXPECT_EQ (0u, pool.failures ());
+
+  EXPECT_THROW (ThreadPool (0), ThreadPoolError);
+}
+
+TEST(ThreadPool,Submit)
+{
+  std::atomic<int> done (0);
+  const int count = 100000;
+  {
+    ThreadPool pool (4);
+    for (int i=0; i < count; ++i)
+    {
+      pool.submit ([&done] { ++done; });
+    }
+  }
+  // The destructor runs everything queued before it returns
+  EXPECT_EQ (count, done.load ());
+}
+
+TEST(ThreadPool,ManySubmitters)
+{
+  std::atomic<int> done (0);
+  const int submitters = 4;
+  const int count = 20000;
+
+  ThreadPool pool (4);
+  std::vector<std::thread> threads;
+  for (int s=0; s < submitters; ++s)
+  {
+    threads.emplace_back ([&]
+                          {
+                            for (int i=0; i < count; ++i)
+                            {
+                              pool.submit ([&done] { ++done; });
+                            }
+                          });
+  }
+  for (auto& t : threads)
+  {
+    t.join ();
+  }
+
+  waitFor (done, submitters * count);
+  EXPECT_EQ (submitters * count, done.load ());
+}
+
+TEST(ThreadPool,Nested)
+{
+  std::atomic<int> done (0);
+  const int count = 1 << 18;
+
+  ThreadPool pool (4);
+  pool.submit ([&] { split (pool, done, count); });
+
+  waitFor (done, count);
+  EXPECT_EQ (count, done.load ());
+}
+
+TEST(ThreadPool,Steal)
+{
+  std::mutex mutex;
+  std::set<std::thread::id> ran;
+  std::atomic<int> done (0);
+  const int count = 200;
+
+  ThreadPool pool (4);
+
+  // Everything lands on one worker's deque, the others have to steal it
+  pool.submit ([&]
+               {
+                 for (int i=0; i < count; ++i)
+                 {
+                   pool.submit ([&]
+                                {
+                                  std::this_thread::sleep_for (std::chrono::microseconds (200));
+                                  {
+                                    std::lock_guard<std::mutex> lock (mutex);
+                                    ran.insert (std::this_thread::get_id ());
+                                  }
+                                  ++done;
+                                });
+                 }
+               });
+
+  waitFor (done, count);
+  EXPECT_EQ (count, done.load ());
+
+  std::lock_guard<std::mutex> lock (mutex);
+  EXPECT_LT (1u, ran.size ());
+}
+
+TEST(ThreadPool,Overflow)
+{
+  std::atomic<int> done (0);
+  const int count = 4 * (ThreadPool::LocalCapacity + ThreadPool::InjectionCapacity);
+
+  // One worker, its deque and the injection queue fill up and it runs the
+  // rest itself
+  ThreadPool pool (1);
+  pool.submit ([&]
+               {
+                 for (int i=0; i < count; ++i)
+                 {
+                   pool.submit ([&done] { ++done; });
+                 }
+               });
+
+  waitFor (done, count);
+  EXPECT_EQ (count, done.load ());
+}
+
+TEST(ThreadPool,InjectionFull)
+{
+  std::atomic<bool> release (false);
+  std::atomic<int> done (0);
+  const int count = 2 * ThreadPool::InjectionCapacity;
+
+  ThreadPool pool (1);
+  pool.submit ([&]
+               {
+                 while (! release)
+                 {
+                   std::this_thread::yield ();
+                 }
+               });
+
+  std::atomic<int> submitted (0);
+  std::thread submitter ([&]
+                         {
+                           for (int i=0; i < count; ++i)
+                           {
+                             pool.submit ([&done] { ++done; });
+                             ++submitted;
+                           }
+                         });
+
+  // The only worker is busy, the submitter has to wait for room
+  std::this_thread::sleep_for (std::chrono::milliseconds (50));
+  EXPECT_GE (static_cast<int> (ThreadPool::InjectionCapacity), submitted.load ());
+  EXPECT_LT (0, submitted.load ());
+
+  release = true;
+  submitter.join ();
+
+  waitFor (done, count);
+  EXPECT_EQ (count, done.load ());
+}
+
+TEST(ThreadPool,Failures)
+{
+  std::atomic<int> done (0);
+  {
+    ThreadPool pool (2);
+    for (int i=0; i < 10; ++i)
+    {
+      pool.submit ([] { throw std::runtime_error ("task"); });
+      pool.submit ([&done] { ++done; });
+    }
+    waitFor (done, 10);
+    for (int i=0; i < 1000 && pool.failures () < 10; ++i)
+    {
+      std::this_thread::sleep_for (std::chrono::milliseconds (1));
+    }
+    EXPECT_EQ (10u, pool.failures ());
+  }
+  EXPECT_EQ (10, done.load ());
+}
+
+TEST(ThreadPool,Shutdown)
+{
+  std::atomic<int> done (0);
+  std::atomic<bool> release (false);
+
+  ThreadPool pool (2);
+  pool.submit ([&]
+               {
+                 while (! release)
+                 {
+                   std::this_thread::yield ();
+                 }
+                 // Workers may still submit after shutdown
+                 pool.submit ([&done] { ++done; });
+                 ++done;
+               });
+
+  pool.shutdown ();
+  EXPECT_TRUE (pool.isShutdown ());
+  EXPECT_THROW (pool.submit ([] { }), ThreadPoolShutdown);
+
+  release = true;
+  waitFor (done, 2);
+  EXPECT_EQ (2, done.load ());
+}
+
+TEST(ThreadPool,ShutdownRace)
+{
+  // Roots submitted from outside race the shutdown, the ones that got in may
+  // only run once the workers are gone and their children must still run
+  for (int round=0; round < 50; ++round)
+  {
+    std::atomic<int> accepted (0);
+    std::atomic<int> children (0);
+    {
+      ThreadPool pool (2);
+      std::thread submitter ([&]
+                             {
+                               try
+                               {
+                                 for (;;)
+                                 {
+                                   pool.submit ([&pool, &children] 
+                                                { 
+                                                  pool.submit ([&children] { ++children; }); 
+                                                });
+                                   ++accepted;
+                                 }
+                               }
+                               catch (const ThreadPoolShutdown&)
+                               {
+                               }
+                             });
+      std::this_thread::sleep_for (std::chrono::microseconds (200));
+      pool.shutdown ();
+      submitter.join ();
+      EXPECT_EQ (0u, pool.failures ());
+    }
+    ASSERT_EQ (accepted.load (), children.load ());
+  }
+}
+
+TEST(ThreadPool,HeapAligned)
+{
+  // The deque cursors are cache line aligned, new has to honour that
+  std::unique_ptr<ThreadPool> pool (new ThreadPool (1));
+  EXPECT_EQ (0u, reinterpret_cast<std::uintptr_t> (pool.get ()) % cdn::container::CacheLineSize);
+}
+
+#if defined(__linux__)
+TEST(ThreadPool,Pinning)
+{
+  cpu_set_t allowed;
+  CPU_ZERO (&allowed);
+  ASSERT_EQ (0, ::sched_getaffinity (0, sizeof (allowed), &allowed));
+  int cpu = 0;
+  while (! CPU_ISSET (cpu, &allowed))
+  {
+    ++cpu;
+  }
+
+  std::atomic<int> done (0);
+  std::atomic<int> elsewhere (0);
+  {
+    ThreadPool pool (2, std::vector<int> { cpu });
+    for (int i=0; i < 100; ++i)
+    {
+      pool.submit ([&, cpu]
+                   {
+                     if (::sched_getcpu () != cpu)
+                     {
+                       ++elsewhere;
+                     }
+                     ++done;
+                   });
+    }
+  }
+  EXPECT_EQ (100, done.load ());
+  EXPECT_EQ (0, elsewhere.load ());
+
+  EXPECT_THROW (ThreadPool (1, std::vector<int> { CPU_SETSIZE - 1 }), ThreadPoolError);
+}
+#endif
@@ -26,7 +26,8 @@ namespace thread
 //! is not copyable or movable therefore DataGuard will not be copyable or movable.
 //! 
 //! If a custom Mutex type is used it must meet the BasicLockable concept 
-//! requirements (http://en.cppreference.com/w/cpp/concept/BasicLockable)
+//! requirements (http://en.cppreference.com/w/cpp/concept/BasicLockable),
+//! try_lock additionally requires the Lockable concept
 //!
 template <typename Datum, typename Mutex = std::mutex>
 class DataGuard final
@@ -104,6 +105,16 @@ public:
     const
     throw (std::system_error);
   
+  //! Required method to meet Lockable concept
+  //! (http://en.cppreference.com/w/cpp/concept/Lockable)
+  //!
+  //! try_lock is usually not called directly, use std::unique_lock with 
+  //! std::try_to_lock. Only available if Mutex is Lockable.
+  bool
+  try_lock ()
+    const
+    throw (std::system_error);
+
   //! Required method to meet BasicLockable concept
   //! (http://en.cppreference.com/w/cpp/concept/BasicLockable)
   //!
@@ -0,0 +1,140 @@
+// EventCount.h
+//
+#ifndef CDN_EVENT_COUNT_INCLUDED
+#define CDN_EVENT_COUNT_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <system_error>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Thread related classes and utilities
+namespace thread
+{
+
+//! \brief The EventCount class lets lock-free code park and wake threads
+//!
+//! An EventCount is the blocking half of a lock-free data structure. The data
+//! structure publishes its state with atomics and only falls back to the
+//! EventCount when a thread has to wait for that state to change. Notifying
+//! an EventCount that has no waiters is a fence and a load, no lock is taken
+//! and no system call is made.
+//!
+//! The waiter protocol is:
+//! \code
+//! auto key = ec.prepareWait ();
+//! if (conditionIsMet ())
+//! {
+//!   ec.cancelWait ();
+//! }
+//! else
+//! {
+//!   ec.commitWait (key);
+//! }
+//! \endcode
+//! and the notifier makes the condition true before calling notifyOne or 
+//! notifyAll. The wait and waitFor helpers wrap that protocol around a 
+//! predicate and should be preferred.
+//!
+class EventCount final
+{
+public:
+  //! Token returned by prepareWait and consumed by commitWait
+  typedef std::uint32_t Key;
+
+  //! No waiters, epoch zero
+  EventCount ()
+    noexcept;
+
+  //! = default
+  ~EventCount () = default;
+
+  //! = delete
+  EventCount (const EventCount&) = delete;
+  //! = delete
+  EventCount& operator= (const EventCount&) = delete;
+
+  //! = delete
+  EventCount (EventCount&&) = delete;
+  //! = delete
+  EventCount& operator= (EventCount&&) = delete;
+
+  //! Announce the intent to wait, the caller must re-check its condition
+  //! after this call and then call either cancelWait or commitWait
+  Key
+  prepareWait ()
+    noexcept;
+
+  //! The condition was met after prepareWait, do not wait
+  void
+  cancelWait ()
+    noexcept;
+
+  //! Wait until notified after the prepareWait that returned key
+  //!
+  //! \throw std::system_error Raise std::system_error on mutex error
+  void
+  commitWait (Key key)
+    throw (std::system_error);
+
+  //! Wait until notified after the prepareWait that returned key or the 
+  //! timeout expires. Return false if the timeout expired.
+  //!
+  //! \throw std::system_error Raise std::system_error on mutex error
+  template <typename Rep, typename Period>
+  bool
+  commitWait (Key key,
+              const std::chrono::duration<Rep, Period>& rel_time)
+    throw (std::system_error);
+
+  //! Block until pred returns true
+  //!
+  //! \throw std::system_error Raise std::system_error on mutex error
+  template <typename Predicate>
+  void
+  wait (Predicate pred)
+    throw (std::system_error);
+
+  //! Block until pred returns true or the timeout expires, returns the last
+  //! result of pred
+  //!
+  //! \throw std::system_error Raise std::system_error on mutex error
+  template <typename Rep, typename Period, typename Predicate>
+  bool
+  waitFor (const std::chrono::duration<Rep, Period>& rel_time,
+           Predicate pred)
+    throw (std::system_error);
+
+  //! Wake one waiting thread, does nothing if there are no waiters
+  void
+  notifyOne ()
+    noexcept;
+
+  //! Wake all waiting threads, does nothing if there are no waiters
+  void
+  notifyAll ()
+    noexcept;
+
+private:
+
+  void
+  notify (bool all)
+    noexcept;
+
+  std::atomic<std::uint32_t> m_epoch;
+  std::atomic<std::uint32_t> m_waiters;
+  std::mutex                 m_mutex;
+  std::condition_variable    m_cond;
+};
+
+} // namespace thread
+} // namespace cdn
+
+#include "EventCount.icc"
+
+#endif // #ifndef CDN_EVENT_COUNT_INCLUDED
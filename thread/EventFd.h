@@ -0,0 +1,78 @@
+// EventFd.h
+//
+#ifndef CDN_EVENT_FD_INCLUDED
+#define CDN_EVENT_FD_INCLUDED
+
+#include <cstdint>
+#include <system_error>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Thread related classes and utilities
+namespace thread
+{
+
+//! \brief The EventFd class is a file descriptor that can be made readable
+//! from any thread
+//!
+//! EventFd lets code that is not a file or a socket, such as a queue, take
+//! part in a poll/epoll/select event loop. signal makes fd () readable and
+//! reset makes it unreadable again, signals raised in between are coalesced.
+//! On Linux it is a non-blocking eventfd, elsewhere the read end of a
+//! non-blocking pipe.
+//!
+//! signal and reset may be called from any thread, neither ever blocks.
+//!
+class EventFd final
+{
+public:
+  //! Not signalled
+  //!
+  //! \throw std::system_error Raise std::system_error if the descriptor can
+  //! not be created
+  EventFd ();
+
+  //! Close the descriptor
+  ~EventFd ();
+
+  //! = delete
+  EventFd (const EventFd&) = delete;
+  //! = delete
+  EventFd& operator= (const EventFd&) = delete;
+
+  //! = delete
+  EventFd (EventFd&&) = delete;
+  //! = delete
+  EventFd& operator= (EventFd&&) = delete;
+
+  //! The descriptor to add to the event loop, watch it for readability
+  int
+  fd ()
+    const
+    noexcept;
+
+  //! Make fd () readable, a no-op when it already is
+  void
+  signal ()
+    noexcept;
+
+  //! Make fd () unreadable
+  //!
+  //! \return true if it was signalled
+  bool
+  reset ()
+    noexcept;
+
+private:
+  int m_readFd;
+  // the same descriptor as m_readFd for an eventfd
+  int m_writeFd;
+};
+
+} // namespace thread
+} // namespace cdn
+
+#include "EventFd.icc"
+
+#endif // #ifndef CDN_EVENT_FD_INCLUDED
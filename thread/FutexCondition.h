@@ -0,0 +1,127 @@
+// FutexCondition.h
+//
+#ifndef CDN_FUTEX_CONDITION_INCLUDED
+#define CDN_FUTEX_CONDITION_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Thread related classes and utilities
+namespace thread
+{
+
+//! \brief The FutexCondition class is a condition variable for any lock,
+//! parked on a Linux futex
+//!
+//! FutexCondition has the wait/notify surface of
+//! <a href="http://en.cppreference.com/w/cpp/thread/condition_variable_any">std::condition_variable_any</a>
+//! and works with any BasicLockable lock, including a DataGuard. On Linux a
+//! waiter reads a 32 bit sequence word while still holding the caller's
+//! lock, releases the lock and sleeps in FUTEX_WAIT for as long as the word
+//! has not changed. A notify advances the word and only makes the
+//! FUTEX_WAKE system call when a thread is actually asleep. Unlike
+//! condition_variable_any there is no internal mutex to take on either side.
+//!
+//! As with any condition variable the caller must change the condition
+//! under the same lock the waiter holds, waits can wake spuriously and the
+//! predicate overloads should be preferred.
+//!
+//! Everywhere but Linux FutexCondition is a thin wrapper around
+//! std::condition_variable_any.
+//!
+class FutexCondition final
+{
+public:
+  //! No waiters
+  //!
+  //! \throw std::system_error Only off Linux, if the condition_variable_any
+  //! can not be created
+  FutexCondition ();
+
+  //! = default
+  ~FutexCondition () = default;
+
+  //! = delete
+  FutexCondition (const FutexCondition&) = delete;
+  //! = delete
+  FutexCondition& operator= (const FutexCondition&) = delete;
+
+  //! = delete
+  FutexCondition (FutexCondition&&) = delete;
+  //! = delete
+  FutexCondition& operator= (FutexCondition&&) = delete;
+
+  //! Release lock and wait for a notify, lock is held again on return
+  template <typename Lock>
+  void
+  wait (Lock& lock);
+
+  //! Wait until pred returns true, pred is called with lock held
+  template <typename Lock, typename Predicate>
+  void
+  wait (Lock& lock, Predicate pred);
+
+  //! Release lock and wait for a notify or abs_time, lock is held again on
+  //! return
+  template <typename Lock, typename Clock, typename Duration>
+  std::cv_status
+  wait_until (Lock& lock,
+              const std::chrono::time_point<Clock, Duration>& abs_time);
+
+  //! Wait until pred returns true or abs_time, returns the last result of
+  //! pred
+  template <typename Lock, typename Clock, typename Duration, typename Predicate>
+  bool
+  wait_until (Lock& lock,
+              const std::chrono::time_point<Clock, Duration>& abs_time,
+              Predicate pred);
+
+  //! Wait until pred returns true or rel_time has passed, returns the last
+  //! result of pred
+  template <typename Lock, typename Rep, typename Period, typename Predicate>
+  bool
+  wait_for (Lock& lock,
+            const std::chrono::duration<Rep, Period>& rel_time,
+            Predicate pred);
+
+  //! Wake one waiting thread, no system call if none is asleep
+  void
+  notify_one ()
+    noexcept;
+
+  //! Wake all waiting threads, no system call if none is asleep
+  void
+  notify_all ()
+    noexcept;
+
+private:
+
+#if defined(__linux__)
+  // Sleep while the sequence word still holds seq, for at most timeoutNs
+  // nanoseconds when timeoutNs is not negative
+  void
+  futexWait (std::uint32_t seq, std::int64_t timeoutNs)
+    noexcept;
+
+  void
+  futexWake (int count)
+    noexcept;
+
+  std::atomic<std::uint32_t> m_sequence;
+  std::atomic<std::uint32_t> m_sleepers;
+#else
+  std::condition_variable_any m_cond;
+#endif
+};
+
+} // namespace thread
+} // namespace cdn
+
+#include "FutexCondition.icc"
+
+#endif // #ifndef CDN_FUTEX_CONDITION_INCLUDED
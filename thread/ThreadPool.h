@@ -0,0 +1,237 @@
+// ThreadPool.h
+//
+#ifndef CDN_THREAD_POOL_INCLUDED
+#define CDN_THREAD_POOL_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EventCount.h"
+
+// TODO: dependency on MpmcQueue
+#include "MpmcQueue.h"
+
+
+//! The main namespace for the codin-lib
+namespace cdn
+{
+//! Thread related classes and utilities
+namespace thread
+{
+
+//! ThreadPool could not start its workers or pin them
+class ThreadPoolError
+  : public std::runtime_error
+{
+public:
+  ThreadPoolError (const std::string&);
+};
+
+//! ThreadPool has been shutdown
+class ThreadPoolShutdown
+  : public std::runtime_error
+{
+public:
+  ThreadPoolShutdown ();
+};
+
+//! \brief The ThreadPool class runs tasks on a fixed set of worker threads
+//! that steal work from each other
+//!
+//! Every worker owns a bounded Chase-Lev deque. A task submitted from inside
+//! a task goes onto the submitting worker's deque, the worker takes its own
+//! tasks from the bottom (newest first, while their data is still in cache)
+//! and idle workers steal from the top of the others' deques. None of this
+//! takes a lock, and a worker only touches another worker's deque when it
+//! has run out of its own work.
+//!
+//! Tasks submitted from any other thread go onto a bounded lock-free
+//! injection queue that every worker drains. submit waits for room when it
+//! is full, a worker whose deque and the injection queue are both full runs
+//! the task itself instead.
+//!
+//! Idle workers spin for a short while and then park on an EventCount, so a
+//! submit that finds every worker busy costs a fence and a load on top of the
+//! push.
+//!
+//! A task that throws is counted in failures, the exception is dropped.
+//!
+//! The deque cursors and the injection queue sit on their own cache lines,
+//! the pool and its workers derive from CacheAligned so they stay that way
+//! when allocated with new.
+//!
+class ThreadPool final
+  : public container::CacheAligned<ThreadPool>
+{
+public:
+  //! The type of the tasks the workers run
+  typedef std::function<void ()> Task;
+
+  //! Number of tasks each worker deque can hold
+  static constexpr std::size_t LocalCapacity = 1024;
+
+  //! Number of tasks the injection queue can hold
+  static constexpr std::size_t InjectionCapacity = 4096;
+
+  //! Start workers threads, if cpus is not empty worker i is pinned to cpu
+  //! cpus[i % cpus.size ()] (Linux only, elsewhere cpus is ignored)
+  //!
+  //! \throw ThreadPoolError Raise ThreadPoolError if workers is zero, the
+  //! workers can not be allocated, a thread can not be started or pinned
+  explicit
+  ThreadPool (std::size_t workers,
+              const std::vector<int>& cpus = std::vector<int> ())
+    throw (ThreadPoolError);
+
+  //! Shutdown, run the tasks still queued and join the workers
+  ~ThreadPool ();
+
+  //! = delete
+  ThreadPool (const ThreadPool&) = delete;
+  //! = delete
+  ThreadPool& operator= (const ThreadPool&) = delete;
+
+  //! = delete
+  ThreadPool (ThreadPool&&) = delete;
+  //! = delete
+  ThreadPool& operator= (ThreadPool&&) = delete;
+
+  //! Number of worker threads
+  std::size_t
+  size ()
+    const
+    noexcept;
+
+  //! Number of tasks that threw
+  std::uint64_t
+  failures ()
+    const
+    noexcept;
+
+  //! Stop accepting tasks from outside the pool, the workers still run every
+  //! task already submitted and the tasks those submit
+  void
+  shutdown ()
+    noexcept;
+
+  //! Return true if the pool has been shutdown
+  bool
+  isShutdown ()
+    const
+    noexcept;
+
+  //! Queue task to run on one of the workers, waiting for room on the
+  //! injection queue when called from outside the pool
+  //!
+  //! \throw ThreadPoolShutdown Raise ThreadPoolShutdown if the pool has been
+  //! shutdown and this is not a worker thread
+  //! \throw ThreadPoolError Raise ThreadPoolError on mutex error
+  //! \throw std::bad_alloc Raise std::bad_alloc if the task can not be
+  //! allocated
+  template <typename Function>
+  void
+  submit (Function&& task);
+
+private:
+
+  static_assert ((LocalCapacity & (LocalCapacity - 1)) == 0,
+                 "ThreadPool::LocalCapacity must be a power of two");
+
+  static constexpr std::size_t CacheLine = container::CacheLineSize;
+
+  // Spin and steal rounds an idle worker makes before it parks
+  static constexpr int SpinRounds = 64;
+
+  //! \brief Internal type for the deque of one worker
+  //!
+  //! The owner pushes and pops at bottom, thieves take from top. The slots
+  //! hold pointers so a thief that loses the race on top has only read a
+  //! pointer it then ignores.
+  struct Worker
+    : container::CacheAligned<Worker>
+  {
+    Worker (ThreadPool*, std::size_t index);
+
+    bool
+    push (Task*)
+      noexcept;
+
+    Task*
+    pop ()
+      noexcept;
+
+    Task*
+    steal ()
+      noexcept;
+
+    bool
+    isEmpty ()
+      const
+      noexcept;
+
+    alignas (CacheLine) std::atomic<std::int64_t> top;
+    alignas (CacheLine) std::atomic<std::int64_t> bottom;
+    std::unique_ptr<std::atomic<Task*>[]>         slots;
+    ThreadPool*                                   pool;
+    // Only touched by the worker thread
+    std::uint64_t                                 random;
+    std::atomic<std::uint64_t>                    failures;
+    std::thread                                   thread;
+  };
+
+  // The worker the calling thread is, null outside of any pool
+  static Worker*&
+  current ()
+    noexcept;
+
+  void
+  run (Worker&)
+    noexcept;
+
+  Task*
+  findTask (Worker&)
+    noexcept;
+
+  Task*
+  stealTask (Worker&)
+    noexcept;
+
+  void
+  execute (Worker&, Task*)
+    noexcept;
+
+  bool
+  hasWork ()
+    const
+    noexcept;
+
+  bool
+  inject (Task*)
+    noexcept;
+
+  void
+  stop ()
+    noexcept;
+
+  std::vector<std::unique_ptr<Worker>>                     m_workers;
+  container::MpmcQueue<Task*, InjectionCapacity>           m_injection;
+  std::atomic<bool>                                        m_isShutdown;
+  // Idle workers park here
+  EventCount                                               m_idle;
+  // Submitters wait here for room on the injection queue
+  EventCount                                               m_room;
+};
+
+} // namespace thread
+} // namespace cdn
+
+#include "ThreadPool.icc"
+
+#endif // #ifndef CDN_THREAD_POOL_INCLUDED